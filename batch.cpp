@@ -0,0 +1,275 @@
+// --- batch.cpp
+#include "batch.h"
+#include "diskItem.h"
+#include "treeCopier.h"
+#include "treeDeleter.h"
+#include <cerrno>
+#include <cstdio>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//The directory is only opened as a path, which is all the items need,
+//and works even if it cannot be read:
+Batch::Batch(const std::string& path)
+{
+	_path = path;
+	if((_path.size() == 0) || (_path[_path.size() - 1] != '/'))
+		_path += '/';
+
+	_fd = open(_path.c_str(), (O_PATH | O_DIRECTORY | O_CLOEXEC));
+	if(_fd < 0)
+		throw errno;
+	_isCut = false;
+}
+
+Batch::~Batch()
+{
+	close(_fd);
+}
+
+void Batch::add(const std::string& name, bool directory)
+{
+	Item item;
+	item.name = name;
+	if((item.name.size() > 0) && (item.name[item.name.size() - 1] == '/'))
+		item.name.erase(item.name.size() - 1);
+	item.directory = directory;
+	item.sized = false;
+	item.size = 0;
+	_items.push_back(item);
+}
+
+void Batch::add(const std::string& name, bool directory, unsigned long long size)
+{
+	add(name, directory);
+	setSize((_items.size() - 1), size);
+}
+
+void Batch::setSize(unsigned int index, unsigned long long size)
+{
+	_items[index].size = size;
+	_items[index].sized = true;
+}
+
+//Marks the batch as cut:
+void Batch::cut()
+{
+	_isCut = true;
+}
+
+//Moves what it can by renaming it, then copies the rest as one batch,
+//with the files copied on a pool of threads, deleting the originals
+//afterwards if the batch was cut:
+bool Batch::paste(const std::string& path, Progress* progress)
+{
+	std::string to = path;
+	if(to[to.size() - 1] != '/')
+		to += '/';
+
+	//Only the size is known beforehand, once every item has been sized,
+	//and the number of items, if none of them are directories:
+	if(progress != NULL)
+	{
+		if(isSized())
+			progress->totalBytes = getSize();
+
+		bool directories = false;
+		for(unsigned int i = 0; i < _items.size(); i++)
+			if(_items[i].directory)
+				directories = true;
+		if(! directories)
+			progress->totalItems = _items.size();
+	}
+
+	//Cut items on the same filesystem are renamed, and leave the batch:
+	std::vector <Item> copying;
+	if(_isCut)
+	{
+		int fd = open(to.c_str(), (O_PATH | O_DIRECTORY | O_CLOEXEC));
+		if(fd < 0)
+			return false;
+
+		//Once anything has failed, or the paste has been cancelled, the
+		//rest are left where they are:
+		std::vector <Item> left;
+		int error = 0;
+		for(unsigned int i = 0; i < _items.size(); i++)
+		{
+			if((error == 0) && (progress != NULL) && (! progress->check()))
+				error = errno;
+			if(error != 0)
+			{
+				left.push_back(_items[i]);
+				continue;
+			}
+
+			const std::string& name = _items[i].name;
+			if(moveItem(_fd, name, fd, name, (_path + name), (to + name)))
+			{
+				if(progress != NULL)
+				{
+					progress->items++;
+					progress->bytes += _items[i].size;
+				}
+				continue;
+			}
+
+			if(errno == EXDEV)
+				copying.push_back(_items[i]);
+			else
+				error = errno;
+			left.push_back(_items[i]);
+		}
+		close(fd);
+		_items.swap(left);
+
+		if(error != 0)
+		{
+			errno = error;
+			return false;
+		}
+	}
+	else
+		copying = _items;
+
+	if(copying.size() == 0)
+		return true;
+
+	//Copies everything else in one go:
+	std::vector <std::string> names;
+	for(unsigned int i = 0; i < copying.size(); i++)
+		names.push_back(copying[i].name);
+
+	unsigned int threads = Walker::getThreads();
+	TreeCopier copier(((threads < 2) ? 2 : threads), progress);
+	if(! copier.copy(_fd, _path, names, to))
+		return false;
+
+	//If the batch was cut, deletes the originals once they have all
+	//been copied, which are only those left in the batch. Each leaves it
+	//as soon as it has gone, so only those which could not be deleted
+	//are kept:
+	if(_isCut)
+	{
+		int error = 0;
+		for(unsigned int i = 0; i < _items.size();)
+		{
+			if(remove(_items[i].name, NULL))
+			{
+				_items.erase(_items.begin() + i);
+				continue;
+			}
+
+			if(error == 0)
+				error = errno;
+			i++;
+		}
+
+		if(error != 0)
+		{
+			errno = error;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//Deletes the items, taking each out of the batch once it has gone:
+bool Batch::deletef(Progress* progress)
+{
+	while(_items.size() > 0)
+	{
+		if((progress != NULL) && (! progress->check()))
+			return false;
+
+		if(! remove(_items.back().name, progress))
+			return false;
+		_items.pop_back();
+	}
+
+	return true;
+}
+
+//A directory is deleted with everything in it, anything else, including
+//a link to a directory, is only unlinked:
+bool Batch::remove(const std::string& name, Progress* progress)
+{
+	struct stat attr;
+	if(fstatat(_fd, name.c_str(), &attr, AT_SYMLINK_NOFOLLOW) != 0)
+		return false;
+
+	if(S_ISDIR(attr.st_mode) != 0)
+	{
+		TreeDeleter deleter(progress);
+		return deleter.remove(_fd, name, (_path + name + '/'));
+	}
+
+	if(unlinkat(_fd, name.c_str(), 0) != 0)
+		return false;
+	if(progress != NULL)
+		progress->items++;
+	return true;
+}
+
+unsigned int Batch::size()
+{
+	return _items.size();
+}
+
+std::string Batch::getName(unsigned int index)
+{
+	return _items[index].name + (_items[index].directory ? "/" : "");
+}
+
+std::string Batch::getItemPath(unsigned int index)
+{
+	return _path + getName(index);
+}
+
+bool Batch::isDirectory(unsigned int index)
+{
+	return _items[index].directory;
+}
+
+bool Batch::isSized(unsigned int index)
+{
+	return _items[index].sized;
+}
+
+std::string Batch::getPath()
+{
+	return _path;
+}
+
+unsigned long long Batch::getSize()
+{
+	unsigned long long size = 0;
+	for(unsigned int i = 0; i < _items.size(); i++)
+		size += _items[i].size;
+	return size;
+}
+
+//Returns the size with a unit, or a placeholder until every item
+//has been sized:
+std::string Batch::getFormattedSize()
+{
+	if(! isSized())
+		return "calculating...";
+	return formatSize(getSize());
+}
+
+bool Batch::isSized()
+{
+	for(unsigned int i = 0; i < _items.size(); i++)
+		if(! _items[i].sized)
+			return false;
+	return true;
+}
+
+bool Batch::isCut()
+{
+	return _isCut;
+}
@@ -0,0 +1,90 @@
+// ---
+// batch.h
+//
+// Contains the class definition for a
+// batch, a set of items in one directory,
+// held as the directory, open, and the
+// items' names, so nothing more is read
+// about them until they are used. A whole
+// batch is copied, moved or deleted as
+// one operation, reusing the directory
+// rather than going through each item's
+// full path.
+// ---
+
+#ifndef BATCH_H
+#define BATCH_H
+#include "progress.h"
+#include <string>
+#include <vector>
+
+class Batch
+{
+	private:
+		//An item's name, without the '/' directories are shown with,
+		//whether it is a directory, and its size, if it is known:
+		struct Item
+		{
+			std::string name;
+			bool directory;
+			bool sized;
+			unsigned long long size;
+		};
+
+		//The directory the items are in, open, and its path, which
+		//ends in a '/':
+		int _fd;
+		std::string _path;
+
+		//The items:
+		std::vector <Item> _items;
+		bool _isCut;
+
+		//Deletes the named item, and everything in it:
+		bool remove(const std::string&, Progress*);
+
+	public:
+		//Default constructor, takes the path of the directory the items
+		//are in. Throws errno if it cannot be opened:
+		Batch(const std::string&);
+
+		//Destructor, closes the directory:
+		~Batch();
+
+		//Adds the named item, which may end in a '/', and whether it is a
+		//directory. Its size can be given if it is already known:
+		void add(const std::string&, bool);
+		void add(const std::string&, bool, unsigned long long);
+
+		//Sets the size of the item at the given place once it has
+		//been calculated:
+		void setSize(unsigned int, unsigned long long);
+
+		//Operation functions. Each works through the items in turn,
+		//stopping at the first which fails, and counts what it has done
+		//in the progress passed, if there is one. Items moved or deleted
+		//are taken out of the batch, so it only holds what is left:
+		void cut();
+		bool paste(const std::string&, Progress* = NULL);
+		bool deletef(Progress* = NULL);
+
+		//Returns the number of items:
+		unsigned int size();
+
+		//Getters, each taking an item's place. Directory names end
+		//in '/':
+		std::string getName(unsigned int);
+		std::string getItemPath(unsigned int);
+		bool isDirectory(unsigned int);
+		bool isSized(unsigned int);
+
+		//Getters for the whole batch. The size is the items' sizes
+		//added up, and is only sized once each of them is:
+		std::string getPath();
+		unsigned long long getSize();
+		std::string getFormattedSize();
+		bool isSized();
+		bool isCut();
+};
+
+#endif
@@ -0,0 +1,858 @@
+// --- bench.cpp
+//
+// Measures the cost of reading a directory and
+// sizing its subdirectories, both with the code
+// as it is and with the original implementation
+// (which built the full path of, and stat'ed, every
+// item, and created a File or Directory for each
+// one while sizing), counting the time taken, the
+// system calls made and the memory allocations.
+// Sizing and listing alone are also measured, the
+// latter with and without io_uring, and streaming
+// only as far as the first run, as is sorting the
+// items with 'byName', pasting the files one at a
+// time, pasting a copy of the whole directory, one
+// item at a time as the original did and through
+// the pipeline, and deleting it again. Sorting a
+// million names, formatting a million sizes and
+// shrinking paths to fit are measured once. Given
+// a file as well, copying it is measured with the
+// original iostream copy and starting from each of
+// the copier's methods.
+//
+// With '--suite', each shape of tree the tree maker
+// knows is made in the directory given, unless it
+// is already there, and each is measured in turn,
+// copying the first of the huge files. With
+// '--json', each result is printed as a JSON object
+// on its own line, for scripts to compare runs.
+#include "diskItem.h"
+#include "directory.h"
+#include "file.h"
+#include "copier.h"
+#include "progress.h"
+#include "statRing.h"
+#include "treeMaker.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//Counts every allocation made by the program, including those
+//made inside the C library, by wrapping its allocator:
+static std::atomic <unsigned long long> allocations(0);
+
+extern "C"
+{
+	void* __libc_malloc(size_t);
+	void* __libc_calloc(size_t, size_t);
+	void* __libc_realloc(void*, size_t);
+
+	void* malloc(size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_malloc(size);
+	}
+
+	void* calloc(size_t count, size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_calloc(count, size);
+	}
+
+	void* realloc(void* p, size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_realloc(p, size);
+	}
+}
+
+//The original recursive size calculation:
+static void legacyCalcSize(Directory* d, unsigned long long& total)
+{
+	total += d->getSize();
+
+	DIR* dir = opendir(d->getPath().c_str());
+	if(dir == NULL)
+		return;
+
+	for(dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if((name == ".") || (name == ".."))
+			continue;
+
+		std::string filepath = d->getPath() + name;
+		struct stat* attr = new struct stat;
+		if(stat(filepath.c_str(), attr) != 0)
+		{
+			delete attr;
+			continue;
+		}
+
+		try
+		{
+			if(S_ISDIR(attr->st_mode) != 0)
+			{
+				Directory* sub = new Directory(filepath.c_str());
+				unsigned long long size = 0;
+				legacyCalcSize(sub, size);
+				total += size;
+				delete sub;
+			}
+			else
+			{
+				File* file = new File(filepath.c_str());
+				total += file->getSize();
+				delete file;
+			}
+		}
+		catch(int e)
+		{
+		}
+		delete attr;
+	}
+	closedir(dir);
+}
+
+//The original reading of a directory, sizing each subdirectory:
+static void legacyRead(const std::string& path)
+{
+	std::vector <DiskItem*> files;
+
+	DIR* dir = opendir(path.c_str());
+	if(dir == NULL)
+		return;
+
+	for(dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if((name == ".") || (name == ".."))
+			continue;
+
+		std::string filepath = path + name;
+		struct stat* attr = new struct stat;
+		if(stat(filepath.c_str(), attr) != 0)
+		{
+			delete attr;
+			continue;
+		}
+
+		try
+		{
+			if(S_ISDIR(attr->st_mode) != 0)
+			{
+				Directory* sub = new Directory(filepath.c_str());
+				unsigned long long size = 0;
+				legacyCalcSize(sub, size);
+				sub->setSize(size);
+				files.push_back(sub);
+			}
+			else
+				files.push_back(new File(filepath.c_str()));
+		}
+		catch(int e)
+		{
+		}
+		delete attr;
+	}
+	closedir(dir);
+
+	std::sort(files.begin(), files.end(), byName);
+	for(unsigned int i = 0; i < files.size(); i++)
+		delete files[i];
+}
+
+//Reading a directory and sizing each subdirectory as it is done now:
+static void currentRead(const std::string& path)
+{
+	Directory dir(path.c_str());
+	dir.read();
+
+	Listing& items = dir.getListing();
+	for(unsigned int i = 0; i < items.size(); i++)
+	{
+		unsigned int id = items.getId(i);
+		if((items.isDirectory(id)) && (! items.isParent(id)))
+		{
+			try
+			{
+				Directory sub(dir.getItemPath(id).c_str());
+				sub.calcSize();
+				items.setSize(id, sub.getSize());
+			}
+			catch(int e)
+			{
+			}
+		}
+	}
+}
+
+//Only sizing a directory, walking the whole tree below it:
+static void currentSize(const std::string& path)
+{
+	Directory dir(path.c_str());
+	dir.calcSize();
+}
+
+//Only listing a directory, without sizing anything, which stats
+//the items of a big directory through io_uring:
+static void currentList(const std::string& path)
+{
+	Directory dir(path.c_str());
+	dir.read();
+}
+
+//Streaming a directory only until its first run can be shown, which
+//takes as long for a huge directory as for a small one:
+static void firstRun(const std::string& path)
+{
+	Directory dir(path.c_str());
+	Progress progress;
+	try
+	{
+		dir.stream([&progress]() { progress.cancel(); }, &progress);
+	}
+	catch(int e)
+	{
+	}
+	unsigned int first = 0;
+	dir.merge(first);
+}
+
+//Only listing a directory, stat'ing each item in turn. This stops
+//io_uring being used by anything after it, so it is run last:
+static void syncList(const std::string& path)
+{
+	StatRing::disable();
+	currentList(path);
+}
+
+//The number of names in the sorting benchmark:
+static const unsigned int SORT_NAMES = 1000000;
+
+//Working out the sort keys for, and sorting, a million made up names,
+//which are only made the first time it is run:
+static void sortNames(const std::string& path)
+{
+	static Listing* listing = NULL;
+	if(listing == NULL)
+	{
+		listing = new Listing;
+		listing->reserve(SORT_NAMES, (SORT_NAMES * 16));
+
+		struct stat attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.st_mode = S_IFREG;
+
+		const char* stems[] = { "file", "Photo_", ".config", "Report-", "track ", "IMG" };
+		unsigned int seed = 1;
+		for(unsigned int i = 0; i < SORT_NAMES; i++)
+		{
+			seed = (seed * 1103515245) + 12345;
+			char name[64];
+			snprintf(name, sizeof(name), "%s%u%c", stems[(seed >> 16) % 6], ((seed >> 8) % 100000), (char)('a' + (seed % 26)));
+			listing->append(name, attr);
+		}
+	}
+
+	listing->resort();
+}
+
+//Returns the name of the numbered directory next to the one given
+//that a copy of it is pasted into:
+static std::string pasteTarget(const std::string& path, unsigned int number)
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".paste%u/", number);
+	return path.substr(0, (path.size() - 1)) + suffix;
+}
+
+//Makes a new, empty directory to paste a copy into, so no copy has
+//to be deleted while the pastes are being timed:
+static std::string pasteTarget(const std::string& path)
+{
+	unsigned int number = 0;
+	while(mkdir(pasteTarget(path, number).c_str(), 0755) != 0)
+		number++;
+	return pasteTarget(path, number);
+}
+
+//The original paste, which copied each item in turn, reading and
+//stat'ing each directory by its path:
+static bool legacyPasteTree(const std::string& from, const std::string& to)
+{
+	struct stat attr;
+	if((stat(from.c_str(), &attr) != 0) || (mkdir(to.c_str(), attr.st_mode) != 0))
+		return false;
+
+	DIR* dir = opendir(from.c_str());
+	if(dir == NULL)
+		return false;
+
+	bool copied = true;
+	for(dirent* entry = readdir(dir); (copied) && (entry != NULL); entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if((name == ".") || (name == ".."))
+			continue;
+
+		if((stat((from + name).c_str(), &attr) == 0) && (S_ISDIR(attr.st_mode) != 0))
+			copied = legacyPasteTree((from + name + '/'), (to + name + '/'));
+		else
+		{
+			try
+			{
+				File file((from + name).c_str());
+				copied = file.paste(to);
+			}
+			catch(int e)
+			{
+				copied = false;
+			}
+		}
+	}
+	closedir(dir);
+	return copied;
+}
+
+static void legacyPaste(const std::string& path)
+{
+	Directory dir(path.c_str());
+	legacyPasteTree(path, (pasteTarget(path) + dir.getName()));
+}
+
+//Pasting the directory as it is done now:
+static void currentPaste(const std::string& path)
+{
+	Directory dir(path.c_str());
+	dir.paste(pasteTarget(path));
+}
+
+//The most files pasted one at a time by the file paste benchmark:
+static const unsigned int FILE_PASTES = 64;
+
+//Pasting the files in the directory one at a time, as a paste of a
+//single file is done:
+static void filePaste(const std::string& path)
+{
+	std::string target = pasteTarget(path);
+
+	DIR* dir = opendir(path.c_str());
+	if(dir == NULL)
+		return;
+
+	unsigned int pasted = 0;
+	for(dirent* entry = readdir(dir); (entry != NULL) && (pasted < FILE_PASTES); entry = readdir(dir))
+	{
+		if(entry->d_type != DT_REG)
+			continue;
+
+		try
+		{
+			File file((path + entry->d_name).c_str());
+			file.paste(target);
+			pasted++;
+		}
+		catch(int e)
+		{
+		}
+	}
+	closedir(dir);
+}
+
+//Deleting the last copy the paste benchmarks made, so the rest are
+//still numbered from the first:
+static void currentDelete(const std::string& path)
+{
+	struct stat attr;
+	unsigned int number = 0;
+	while(stat(pasteTarget(path, number).c_str(), &attr) == 0)
+		number++;
+	if(number == 0)
+		return;
+
+	try
+	{
+		Directory dir(pasteTarget(path, (number - 1)).c_str());
+		dir.deletef();
+	}
+	catch(int e)
+	{
+	}
+}
+
+//Sorting the items in the directory with 'byName', as the original did,
+//from the items made the first time it is run on the directory:
+static void byNameSort(const std::string& path)
+{
+	static std::string made;
+	static std::vector <DiskItem*> items;
+	if(made != path)
+	{
+		for(unsigned int i = 0; i < items.size(); i++)
+			delete items[i];
+		items.clear();
+		made = path;
+
+		DIR* dir = opendir(path.c_str());
+		if(dir == NULL)
+			return;
+		for(dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+			if((name == ".") || (name == ".."))
+				continue;
+
+			try
+			{
+				if(entry->d_type == DT_DIR)
+					items.push_back(new Directory((path + name).c_str()));
+				else
+					items.push_back(new File((path + name).c_str()));
+			}
+			catch(int e)
+			{
+			}
+		}
+		closedir(dir);
+	}
+
+	std::vector <DiskItem*> sorted(items.rbegin(), items.rend());
+	std::sort(sorted.begin(), sorted.end(), byName);
+}
+
+//The number of sizes formatted, and paths shrunk, by the benchmarks:
+static const unsigned int FORMAT_SIZES = 1000000;
+static const unsigned int FIT_PATHS = 100000;
+
+//Formatting a million sizes, of every magnitude:
+static void formatSizes(const std::string& path)
+{
+	unsigned long long seed = 1;
+	size_t length = 0;
+	for(unsigned int i = 0; i < FORMAT_SIZES; i++)
+	{
+		seed = (seed * 6364136223846793005ULL) + 1442695040888963407ULL;
+		length += formatSize(seed >> (seed % 64)).size();
+	}
+	if(length == 0)
+		std::cerr << "Nothing formatted\n";
+}
+
+//Shrinking a hundred thousand made up paths to fit a window's width:
+static void fitPaths(const std::string& path)
+{
+	static std::vector <std::string> paths;
+	if(paths.empty())
+	{
+		const char* parts[] = { "home", "Documents", "projects", "trilobite", "src", "build", "a very long directory name", "x" };
+		unsigned int seed = 1;
+		for(unsigned int i = 0; i < FIT_PATHS; i++)
+		{
+			std::string made = "/";
+			unsigned int depth = 3 + (i % 10);
+			for(unsigned int j = 0; j < depth; j++)
+			{
+				seed = (seed * 1103515245) + 12345;
+				made += std::string(parts[(seed >> 16) % 8]) + '/';
+			}
+			paths.push_back(made);
+		}
+	}
+
+	size_t length = 0;
+	for(unsigned int i = 0; i < paths.size(); i++)
+		length += fitToSize(paths[i], 40).size();
+	if(length == 0)
+		std::cerr << "Nothing shrunk\n";
+}
+
+//Deletes the copies the paste benchmarks made:
+static int removeCopy(const char* path, const struct stat* attr, int type, struct FTW* ftw)
+{
+	return remove(path);
+}
+
+//The method the copy benchmark starts from, and the one it ended with:
+static Copier::Method copyMethod = Copier::CLONE;
+static Copier::Method copyUsed = Copier::CLONE;
+
+//The original copy, through iostream's buffers, to the file's name
+//with '.copy' added:
+static void legacyCopy(const std::string& path)
+{
+	std::string copy = path + ".copy";
+	unlink(copy.c_str());
+
+	std::ifstream in(path.c_str(), std::ios::binary);
+	std::ofstream out(copy.c_str(), std::ios::binary);
+	out << in.rdbuf();
+	in.close();
+	out.close();
+}
+
+//Copying the file as it is done now, to the same place:
+static void currentCopy(const std::string& path)
+{
+	std::string copy = path + ".copy";
+	unlink(copy.c_str());
+
+	int in = open(path.c_str(), (O_RDONLY | O_CLOEXEC));
+	int out = open(copy.c_str(), (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC), 0644);
+	copyUsed = copyMethod;
+	if((in < 0) || (out < 0) || (! Copier::copy(in, out, copyUsed)))
+		std::cerr << "Cannot copy '" << path << "': " << strerror(errno) << std::endl;
+	close(in);
+	close(out);
+}
+
+//Runs the function in a child process traced with ptrace, and
+//returns the number of system calls made by all of its threads:
+static long countSyscalls(void (*function)(const std::string&), const std::string& path)
+{
+	pid_t pid = fork();
+	if(pid < 0)
+		return -1;
+
+	if(pid == 0)
+	{
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		function(path);
+		_exit(0);
+	}
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	ptrace(PTRACE_SETOPTIONS, pid, NULL, (PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+	ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+	//Every system call stops the thread making it twice, once on
+	//the way in and once on the way out:
+	long stops = 0;
+	while(true)
+	{
+		pid_t thread = waitpid(-1, &status, __WALL);
+		if(thread < 0)
+			break;
+		if(! WIFSTOPPED(status))
+			continue;
+
+		int signal = 0;
+		if(WSTOPSIG(status) == (SIGTRAP | 0x80))
+			stops++;
+		else if((WSTOPSIG(status) != SIGTRAP) && (WSTOPSIG(status) != SIGSTOP))
+			signal = WSTOPSIG(status);
+
+		ptrace(PTRACE_SYSCALL, thread, NULL, signal);
+	}
+
+	return (stops + 1) / 2;
+}
+
+//The results of running one scenario on one tree:
+struct Result
+{
+	std::string tree;
+	std::string name;
+	std::string path;
+	void (*function)(const std::string&);
+	double ms;
+	long syscalls;
+	unsigned long long allocations;
+};
+
+//Runs the function, recording the time it takes and the allocations
+//it makes. It is run once first so every run sees the same warm caches:
+static void measure(Result& result, void (*function)(const std::string&), const std::string& path)
+{
+	function(path);
+
+	unsigned long long before = allocations;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	function(path);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	result.allocations = allocations - before;
+	result.ms = std::chrono::duration <double, std::milli>(end - start).count();
+}
+
+
+//A scenario, and whether it is run on each tree or just once:
+struct Scenario
+{
+	const char* name;
+	void (*function)(const std::string&);
+	bool perTree;
+};
+
+//Every scenario, in the order they are run. Listing without io_uring
+//stops it being used by anything after, so it is always run last:
+static const Scenario SCENARIOS[] =
+{
+	{ "legacy read", legacyRead, true },
+	{ "read", currentRead, true },
+	{ "size", currentSize, true },
+	{ "by name", byNameSort, true },
+	{ "list", currentList, true },
+	{ "first run", firstRun, true },
+	{ "file paste", filePaste, true },
+	{ "legacy paste", legacyPaste, true },
+	{ "paste", currentPaste, true },
+	{ "delete", currentDelete, true },
+	{ "sort 1M", sortNames, false },
+	{ "format 1M", formatSizes, false },
+	{ "fit 100k", fitPaths, false },
+	{ "list (sync)", syncList, true }
+};
+static const unsigned int SCENARIO_COUNT = (sizeof(SCENARIOS) / sizeof(SCENARIOS[0]));
+
+//Prints the results, as a table, or as a JSON object on each line:
+static void printResults(const std::vector <Result>& results, bool json, bool trees)
+{
+	if(! json)
+	{
+		if(trees)
+			std::cout << std::left << std::setw(10) << "tree";
+		std::cout << std::left << std::setw(16) << "scenario" << std::right
+			<< std::setw(12) << "time (ms)"
+			<< std::setw(14) << "syscalls"
+			<< std::setw(14) << "allocations" << std::endl;
+	}
+
+	for(unsigned int i = 0; i < results.size(); i++)
+	{
+		if(json)
+		{
+			std::cout << "{\"tree\":" << quote(results[i].tree)
+				<< ",\"scenario\":" << quote(results[i].name)
+				<< ",\"ms\":" << std::fixed << std::setprecision(3) << results[i].ms
+				<< ",\"syscalls\":" << results[i].syscalls
+				<< ",\"allocations\":" << results[i].allocations << "}" << std::endl;
+			continue;
+		}
+
+		if(trees)
+			std::cout << std::left << std::setw(10) << results[i].tree;
+		std::cout << std::left << std::setw(16) << results[i].name << std::right
+			<< std::setw(12) << std::fixed << std::setprecision(2) << results[i].ms
+			<< std::setw(14) << results[i].syscalls
+			<< std::setw(14) << results[i].allocations << std::endl;
+	}
+}
+
+//Copies the file given with each method, showing which one actually
+//did the copy when the first could not be used:
+static bool measureCopies(const std::string& file, bool json)
+{
+	struct stat attr;
+	if(stat(file.c_str(), &attr) != 0)
+	{
+		std::cerr << "Cannot open '" << file << "': " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	const char* methods[] = { "clone", "copy_file_range", "sendfile", "read/write" };
+	if(! json)
+	{
+		std::cout << std::endl << std::left << std::setw(34) << "copy" << std::right
+			<< std::setw(12) << "time (ms)"
+			<< std::setw(10) << "GB/s" << std::endl;
+	}
+
+	for(int i = -1; i <= Copier::READ_WRITE; i++)
+	{
+		Result result;
+		std::string name = "iostream";
+		std::string used = name;
+		if(i < 0)
+			measure(result, legacyCopy, file);
+		else
+		{
+			copyMethod = (Copier::Method)i;
+			measure(result, currentCopy, file);
+			name = methods[i];
+			used = methods[copyUsed];
+		}
+		double rate = ((attr.st_size / 1e9) / (result.ms / 1000));
+
+		if(json)
+		{
+			std::cout << "{\"copy\":" << quote(name) << ",\"used\":" << quote(used)
+				<< ",\"bytes\":" << attr.st_size
+				<< ",\"ms\":" << std::fixed << std::setprecision(3) << result.ms
+				<< ",\"gbps\":" << std::setprecision(3) << rate << "}" << std::endl;
+			continue;
+		}
+
+		if(used != name)
+			name += " (used " + used + ")";
+		std::cout << std::left << std::setw(34) << name << std::right
+			<< std::setw(12) << std::fixed << std::setprecision(2) << result.ms
+			<< std::setw(10) << std::setprecision(2) << rate << std::endl;
+	}
+	unlink((file + ".copy").c_str());
+	return true;
+}
+
+//Returns the path of the tree of the given shape in the directory:
+static std::string treePath(const std::string& dir, TreeMaker::Shape shape)
+{
+	return dir + TreeMaker::getName(shape) + '/';
+}
+
+static void usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [--json] DIR [FILE]\n"
+		<< "       " << name << " [--json] [--scale N] --suite DIR\n"
+		<< "       " << name << " [--scale N] --generate SHAPE DIR\n"
+		<< "Shapes: wide, deep, small, huge, sparse\n";
+}
+
+int main(int argc, char* argv[])
+{
+	//Reads the options, leaving the paths:
+	bool json = false;
+	bool suite = false;
+	unsigned int scale = 1;
+	std::string generate;
+	std::vector <std::string> paths;
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if(arg == "--json")
+			json = true;
+		else if(arg == "--suite")
+			suite = true;
+		else if((arg == "--scale") && ((i + 1) < argc))
+			scale = strtoul(argv[++i], NULL, 10);
+		else if((arg == "--generate") && ((i + 1) < argc))
+			generate = argv[++i];
+		else if((arg.size() > 1) && (arg[0] == '-'))
+		{
+			usage(argv[0]);
+			return -1;
+		}
+		else
+			paths.push_back(arg);
+	}
+
+	if((paths.size() < 1) || (paths.size() > ((suite || (generate != "")) ? 1 : 2)) || ((suite) && (generate != "")))
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	std::string path = paths[0];
+	if(path[path.size() - 1] != '/')
+		path += '/';
+
+	//Only makes the tree asked for:
+	if(generate != "")
+	{
+		TreeMaker::Shape shape;
+		if(! TreeMaker::parse(generate, shape))
+		{
+			usage(argv[0]);
+			return -1;
+		}
+		if(! TreeMaker::make(shape, path, scale))
+		{
+			std::cerr << "Cannot make '" << path << "': " << strerror(errno) << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	//Keeps the size cache out of it, so every size is walked:
+	unsetenv("XDG_CACHE_HOME");
+	unsetenv("HOME");
+
+	//The trees measured, which for a suite are each shape, made in the
+	//directory given unless they were made by an earlier run:
+	std::vector <std::string> trees, names;
+	if(suite)
+	{
+		mkdir(path.c_str(), 0755);
+		for(unsigned int i = 0; i < TreeMaker::SHAPES; i++)
+		{
+			TreeMaker::Shape shape = (TreeMaker::Shape)i;
+			struct stat attr;
+			if((stat(treePath(path, shape).c_str(), &attr) != 0) && (! TreeMaker::make(shape, treePath(path, shape), scale)))
+			{
+				std::cerr << "Cannot make '" << treePath(path, shape) << "': " << strerror(errno) << std::endl;
+				return -1;
+			}
+			trees.push_back(treePath(path, shape));
+			names.push_back(TreeMaker::getName(shape));
+		}
+	}
+	else
+	{
+		trees.push_back(path);
+		names.push_back(path);
+	}
+
+	//Each scenario run on each tree, with those run once given no tree:
+	std::vector <Result> results;
+	for(unsigned int i = 0; i < SCENARIO_COUNT; i++)
+	{
+		for(unsigned int j = 0; j < (SCENARIOS[i].perTree ? trees.size() : 1); j++)
+		{
+			Result result;
+			result.tree = (SCENARIOS[i].perTree ? names[j] : "-");
+			result.name = SCENARIOS[i].name;
+			result.path = trees[j];
+			result.function = SCENARIOS[i].function;
+			results.push_back(result);
+		}
+	}
+
+	//The system calls are counted first, in children forked before
+	//this process starts any threads, as a forked child only gets
+	//the thread that forked it:
+	for(unsigned int i = 0; i < results.size(); i++)
+		results[i].syscalls = countSyscalls(results[i].function, results[i].path);
+	for(unsigned int i = 0; i < results.size(); i++)
+		measure(results[i], results[i].function, results[i].path);
+
+	printResults(results, json, suite);
+
+	//Deletes the pasted copies, including those made by the children:
+	for(unsigned int i = 0; i < trees.size(); i++)
+		for(unsigned int j = 0; nftw(pasteTarget(trees[i], j).c_str(), removeCopy, 64, (FTW_DEPTH | FTW_PHYS)) == 0; j++);
+
+	//Copies the file given, or the first of the huge files, if there is one:
+	std::string file = (paths.size() == 2) ? paths[1] : "";
+	if(suite)
+	{
+		DIR* dir = opendir(treePath(path, TreeMaker::HUGE).c_str());
+		for(dirent* entry = (dir != NULL) ? readdir(dir) : NULL; (entry != NULL) && (file == ""); entry = readdir(dir))
+			if(entry->d_type == DT_REG)
+				file = treePath(path, TreeMaker::HUGE) + entry->d_name;
+		if(dir != NULL)
+			closedir(dir);
+	}
+	if((file != "") && (! measureCopies(file, json)))
+		return -1;
+
+	return 0;
+}
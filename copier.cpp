@@ -0,0 +1,195 @@
+// --- copier.cpp
+#include "copier.h"
+#include "stats.h"
+#include <cerrno>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+//The most copied by one call, so a huge file is not one long call, and
+//its progress is seen, and it can be paused or cancelled, as it goes:
+static const size_t CHUNK_SIZE = (1 << 26);
+
+//The buffer each thread copies through, only allocated if the kernel
+//cannot do the copy itself, and kept for its next copy:
+static thread_local std::vector <char> buffer;
+
+//Copies the first file into the second:
+bool Copier::copy(int in, int out, Method& method, Progress* progress)
+{
+	struct stat attr;
+	if(fstat(in, &attr) != 0)
+		return false;
+
+	return copy(in, out, attr, method, progress);
+}
+
+//Copies the first file into the second, using the attributes given:
+bool Copier::copy(int in, int out, const struct stat& attr, Method& method, Progress* progress)
+{
+	if((progress != NULL) && (! progress->check()))
+		return false;
+
+	//A clone shares the extents, holes and all, so nothing is copied:
+	if(method == CLONE)
+	{
+		Stats::count(Stats::SYSCALLS);
+		if(ioctl(out, FICLONE, in) == 0)
+		{
+			Stats::count(Stats::COPIED, attr.st_size);
+			if(progress != NULL)
+				progress->bytes += attr.st_size;
+			return true;
+		}
+		method = COPY_RANGE;
+	}
+
+	//Files which do not know their size, like those in /proc, can
+	//only be read until they end:
+	if((! S_ISREG(attr.st_mode)) || (attr.st_size == 0))
+	{
+		method = READ_WRITE;
+		return copyRange(in, out, 0, -1, method, progress);
+	}
+
+	//A file with as many blocks as it needs has no holes, so it is
+	//copied in one go, without looking for them:
+	off_t size = attr.st_size;
+	if((attr.st_blocks * 512) >= size)
+		return copyRange(in, out, 0, size, method, progress);
+
+	//Copies each run of data, skipping the holes between them, which
+	//count as done as they are passed:
+	off_t pos = 0;
+	while(pos < size)
+	{
+		off_t start = lseek(in, pos, SEEK_DATA);
+		off_t end = size;
+		if(start < 0)
+		{
+			//Only a hole is left:
+			if(errno == ENXIO)
+				break;
+
+			//The filesystem cannot find holes, so it is all data:
+			start = pos;
+		}
+		else
+		{
+			end = lseek(in, start, SEEK_HOLE);
+			if((end < 0) || (end > size))
+				end = size;
+		}
+
+		if(progress != NULL)
+			progress->bytes += (start - pos);
+		if(! copyRange(in, out, start, end, method, progress))
+			return false;
+		pos = end;
+	}
+	if(progress != NULL)
+		progress->bytes += (size - pos);
+
+	//Makes the copy the full size, leaving any hole at the end:
+	if(ftruncate(out, size) != 0)
+		return false;
+
+	return true;
+}
+
+//Copies the data in the given range, falling back to the next method
+//whenever one cannot be used for these files:
+bool Copier::copyRange(int in, int out, off_t start, off_t end, Method& method, Progress* progress)
+{
+	off_t pos = start;
+	while((end < 0) || (pos < end))
+	{
+		size_t length = (end < 0) ? BUFFER_SIZE : (size_t)(end - pos);
+		if(length > CHUNK_SIZE)
+			length = CHUNK_SIZE;
+
+		ssize_t copied = -1;
+		if(method == COPY_RANGE)
+		{
+			loff_t from = pos, to = pos;
+			copied = copy_file_range(in, &from, out, &to, length, 0);
+			if((copied < 0) && ((errno == EXDEV) || (errno == ENOSYS) || (errno == EOPNOTSUPP) || (errno == EINVAL)))
+			{
+				method = SENDFILE;
+				continue;
+			}
+		}
+		else if(method == SENDFILE)
+		{
+			//Sendfile writes wherever the second file is up to:
+			off_t from = pos;
+			if(lseek(out, pos, SEEK_SET) < 0)
+				return false;
+
+			copied = sendfile(out, in, &from, length);
+			if((copied < 0) && ((errno == EINVAL) || (errno == ENOSYS)))
+			{
+				method = READ_WRITE;
+				continue;
+			}
+		}
+		else
+		{
+			if(buffer.size() < BUFFER_SIZE)
+				buffer.resize(BUFFER_SIZE);
+			if(length > BUFFER_SIZE)
+				length = BUFFER_SIZE;
+
+			copied = pread(in, &buffer[0], length, pos);
+
+			//Writes all of what was read, which may take more than one go:
+			for(ssize_t written = 0; written < copied;)
+			{
+				ssize_t result = pwrite(out, (&buffer[0] + written), (copied - written), (pos + written));
+				if(result < 0)
+				{
+					if(errno == EINTR)
+						continue;
+					return false;
+				}
+				written += result;
+			}
+		}
+
+		Stats::count(Stats::SYSCALLS);
+		if(copied < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+
+		//Either the file has ended early, or the kernel could not copy
+		//it, as some filesystems only say by copying nothing. Reading
+		//it tells which:
+		if(copied == 0)
+		{
+			if(method != READ_WRITE)
+			{
+				method = READ_WRITE;
+				continue;
+			}
+			break;
+		}
+
+		pos += copied;
+		Stats::count(Stats::COPIED, copied);
+		if(progress != NULL)
+		{
+			progress->bytes += copied;
+			if(! progress->check())
+				return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,49 @@
+// ---
+// copier.h
+//
+// Contains the class definition for the
+// copier, which copies the data of one
+// open file into another without passing
+// it through the program where it can:
+// first by sharing the extents with a
+// clone, then by asking the kernel to copy
+// them, and only then through a buffer.
+// Holes in sparse files are kept.
+// ---
+
+#ifndef COPIER_H
+#define COPIER_H
+#include "progress.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+
+class Copier
+{
+	public:
+		//The ways of copying, fastest first. Each one that cannot
+		//be used falls back to the next:
+		enum Method { CLONE, COPY_RANGE, SENDFILE, READ_WRITE };
+
+		//The size of the buffer read into and written from:
+		static const size_t BUFFER_SIZE = (1 << 20);
+
+		//Copies everything in the first file into the second, which
+		//should be empty, starting with the method passed. Afterwards
+		//the method is the one that finished the copy. The bytes copied
+		//are counted in the progress, if one is given, which is checked
+		//between each chunk. Returns false, with errno set, if the copy
+		//failed or was cancelled:
+		static bool copy(int, int, Method&, Progress* = NULL);
+
+		//Copies the first file, whose attributes have already been
+		//read, into the second:
+		static bool copy(int, int, const struct stat&, Method&, Progress* = NULL);
+
+	private:
+		//Copies the data between the two offsets, to the same place
+		//in the second file, or until the first ends if the second
+		//offset is negative:
+		static bool copyRange(int, int, off_t, off_t, Method&, Progress*);
+};
+
+#endif
@@ -0,0 +1,55 @@
+// --- dirReader.cpp
+#include "dirReader.h"
+#include "stats.h"
+#include <cerrno>
+#include <dirent.h>
+
+DirReader::DirReader(int fd, char* buffer, size_t size)
+{
+	_fd = fd;
+	_buffer = buffer;
+	_size = size;
+	_length = 0;
+	_pos = 0;
+	_read = 0;
+}
+
+//Gets the name and type of the next item:
+bool DirReader::next(const char*& name, unsigned char& type)
+{
+	while(true)
+	{
+		//Reads the next batch of entries once the last is used up:
+		if(_pos >= _length)
+		{
+			Stats::count(Stats::SCANNED, _read);
+			Stats::count(Stats::SYSCALLS);
+			_read = 0;
+
+			//A failed read is not the end of the directory, or what
+			//had been read so far would be taken for all of it:
+			_length = getdents64(_fd, _buffer, _size);
+			_pos = 0;
+			if(_length < 0)
+			{
+				_length = 0;
+				throw errno;
+			}
+			if(_length == 0)
+				return false;
+		}
+
+		struct dirent64* entry = (struct dirent64*)(_buffer + _pos);
+		_pos += entry->d_reclen;
+
+		//Skips '.' and '..':
+		const char* n = entry->d_name;
+		if((n[0] == '.') && ((n[1] == '\0') || ((n[1] == '.') && (n[2] == '\0'))))
+			continue;
+
+		name = n;
+		type = entry->d_type;
+		_read++;
+		return true;
+	}
+}
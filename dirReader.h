@@ -0,0 +1,47 @@
+// ---
+// dirReader.h
+//
+// Contains the class definition for the
+// directory reader, which reads the items
+// in an open directory straight from the
+// kernel with getdents64, many at a time,
+// into a buffer owned by the caller, so
+// reading a directory makes no allocations.
+// ---
+
+#ifndef DIR_READER_H
+#define DIR_READER_H
+#include <cstddef>
+
+class DirReader
+{
+	private:
+		//The open directory:
+		int _fd;
+
+		//The caller's buffer, and how much of it holds entries:
+		char* _buffer;
+		size_t _size;
+		long _length;
+		long _pos;
+
+		//The entries handed out since they were last counted:
+		unsigned int _read;
+
+	public:
+		//The size of buffer that should be passed in:
+		static const size_t BUFFER_SIZE = 65536;
+
+		//Default constructor, takes an open directory and
+		//a buffer to read into:
+		DirReader(int, char*, size_t);
+
+		//Gets the name and type (one of the 'DT_' values, which may
+		//be DT_UNKNOWN) of the next item, skipping '.' and '..'.
+		//Returns false once there are no more, and throws errno if
+		//the directory cannot be read. The items are counted in the
+		//stats a batch at a time:
+		bool next(const char*&, unsigned char&);
+};
+
+#endif
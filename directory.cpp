@@ -1,23 +1,47 @@
 // --- directory.cpp
 #include "directory.h"
 #include "file.h"
+#include "sizeCache.h"
+#include "dirReader.h"
+#include "statRing.h"
+#include "treeCopier.h"
+#include "treeDeleter.h"
+#include "stats.h"
 #include <cerrno>
 #include <fstream>
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <string>
 #include <algorithm>
+#include <thread>
+#include <cstdint>
+
+//The most items whose room 'read()' keeps after reading them:
+static const size_t SCRATCH_LIMIT = 65536;
+
+//The room 'read()' works in, kept by each thread between reads, so
+//reading a directory does not have to allocate it all again:
+struct ReadScratch
+{
+	std::vector <char> buffer;
+	std::string pool;
+	std::vector <size_t> offsets;
+	std::vector <const char*> names;
+	std::vector <struct stat> attrs;
+	std::vector <int> errors;
+};
+static thread_local ReadScratch scratch;
 
 Directory::Directory(const char* path)
 {
 	//Reads the directory's attributes into '_attr':
-	_attr = new struct stat;
-	if(stat(path, _attr) != 0)
+	if(stat(path, &_attr) != 0)
 		throw errno;
 
 	//Checks the passed file is a directory:
-	if(S_ISDIR(_attr->st_mode) == 0)
+	if(S_ISDIR(_attr.st_mode) == 0)
 	{
 		errno = ENOTDIR;
 		throw errno;
@@ -28,271 +52,247 @@ Directory::Directory(const char* path)
 	if(_path[_path.size() - 1] != '/')
 		_path += '/';
 
+	//The size is not known until 'calcSize()' is called:
+	_size = 0;
+	_sized = false;
+
 	_isCut = false;
 }
 
-//Makes a copy of the passed DiskItem:
-Directory::Directory(Directory* dir)
+//Takes the path and the attributes already read for it:
+Directory::Directory(const std::string& path, const struct stat& attr)
 {
-	//Copies the passed directory's data:
-	_size = dir->getSize();
-	_path = dir->getPath();
-	_files = dir->getFiles();
-	_isCut = false;
+	_attr = attr;
+
+	//Sets the directory path, adds a '/' if there is not one:
+	_path = path;
+	if(_path[_path.size() - 1] != '/')
+		_path += '/';
 
-	if(getName() == "../")
-		cleanPath();
+	//The size is not known until 'calcSize()' is called:
+	_size = 0;
+	_sized = false;
 
-	//Reads the directory's attributes into '_attr':
-	_attr = new struct stat;
-	if(stat(_path.c_str(), _attr) != 0)
-		throw errno;
+	_isCut = false;
 }
 
 Directory::~Directory()
 {
-	//Deletes all the file and directory objects
-	//associated with the directory:
-	for(unsigned int i = 0; i < _files.size(); i++)
-		delete _files[i];
-
-	//Deletes the struct stat:
-	delete _attr;
+	//Runs read but never merged:
+	for(unsigned int i = 0; i < _runs.size(); i++)
+		delete _runs[i];
 }
 
-//Reads the first layer of files and directories:
-void Directory::read()
+//Stats the items whose names have been read into the scratch, and
+//returns them as a sorted listing:
+static Listing* makeRun(int fd)
 {
-	//Creates a pointer to a 'DIR' struct:
-	DIR* dir = opendir(_path.c_str());
-	if(dir == NULL)
-		throw errno;
-
-	//Creates a pointer to a 'dirent' struct:
-	dirent* dir_contents = readdir(dir);
+	std::string& pool = scratch.pool;
+	std::vector <size_t>& offsets = scratch.offsets;
+	std::vector <const char*>& names = scratch.names;
+	names.clear();
+	for(unsigned int i = 0; i < offsets.size(); i++)
+		names.push_back(pool.c_str() + offsets[i]);
+
+	//Checks if each item is a directory or a file, following links so
+	//a link to a directory can be entered. Big runs are stat'ed all at
+	//once through io_uring, and the rest one at a time:
+	std::vector <struct stat>& attrs = scratch.attrs;
+	std::vector <int>& errors = scratch.errors;
+	StatRing* ring = NULL;
+	if(names.size() >= StatRing::THRESHOLD)
+		ring = StatRing::get();
+	if((ring == NULL) || (! ring->stat(fd, names, true, attrs, errors)))
+	{
+		attrs.resize(names.size());
+		errors.assign(names.size(), 0);
+		for(unsigned int i = 0; i < names.size(); i++)
+			if(fstatat(fd, names[i], &attrs[i], 0) != 0)
+				errors[i] = errno;
+		Stats::count(Stats::SYSCALLS, names.size());
+	}
 
-	//While there is stuff to read:
-	while(dir_contents != 0)
+	Listing* run = new Listing();
+	run->reserve(names.size(), pool.size());
+	for(unsigned int i = 0; i < names.size(); i++)
 	{
-		//Get the name of the next item:
-		std::string name = dir_contents->d_name;
+		//Items that could not be stat'ed are left out. Directory sizes
+		//are left to be calculated in the background:
+		if(errors[i] == 0)
+			run->append(names[i], attrs[i]);
+	}
+	run->sort();
 
-		//Checks we are not reading ".":
-		if((name == ".") || (name == ".."))
-		{
-			//Read the next entry:
-			dir_contents = readdir(dir);
-			continue;
-		}
+	return run;
+}
 
-		//Construct the full path of the item:
-		std::string filepath = _path + name;
+//Reads the names a run at a time, handing each run on once it has been
+//stat'ed and sorted, with the first no bigger than the size given, and
+//each after twice the size of the last:
+void Directory::scan(size_t size, const std::function <void(Listing*)>& publish, Progress* progress)
+{
+	Stats::Span span(Stats::READ);
 
-		DiskItem* file = NULL;
+	//Opens the directory, so each item can be stat'ed relative to it
+	//rather than by building and looking up its full path:
+	int fd = open(_path.c_str(), (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if(fd < 0)
+		throw errno;
 
-		//Checks if the path is a directory or a file:
-		struct stat* attr = new struct stat;
-		if(stat(filepath.c_str(), attr) != 0)
+	//Reads the items many at a time, straight from the kernel, keeping
+	//the names of each run together so they can all be stat'ed at once:
+	scratch.buffer.resize(DirReader::BUFFER_SIZE);
+	DirReader reader(fd, &scratch.buffer[0], scratch.buffer.size());
+	const char* name = NULL;
+	unsigned char type = DT_UNKNOWN;
+	std::string& pool = scratch.pool;
+	std::vector <size_t>& offsets = scratch.offsets;
+	pool.clear();
+	offsets.clear();
+
+	//The last run is handed on even if it is empty, so an empty
+	//directory still has one:
+	bool more = true;
+	while(more)
+	{
+		try
 		{
-			//Delete the 'struct stat':
-			delete attr;
-
-			//Read the next entry:
-			dir_contents = readdir(dir);
-			continue;
+			more = reader.next(name, type);
 		}
-
-		//If it is a directory:
-		if(S_ISDIR(attr->st_mode) != 0)
+		catch(int e)
 		{
-			//Attempt to open the directory:
-			try
-			{
-				file = new Directory(filepath.c_str());	
-
-				//Attempt to calculate it's size:
-				file->calcSize();
-			}
-			//If an error occurs:
-			catch(int e)
-			{
-				//Delete the 'struct stat':
-				delete attr;
+			close(fd);
+			throw e;
+		}
 
-				//Read the next entry:
-				dir_contents = readdir(dir);
+		if(more)
+		{
+			offsets.push_back(pool.size());
+			pool.append(name);
+			pool.push_back('\0');
+			if(offsets.size() < size)
 				continue;
-			}
 		}
-		//Otherwise, it is a file:
-		else
-		{
-			//Attempt to open the file:
-			try
-			{
-				file = new File(filepath.c_str());
-			}
-			//If an error occurs:
-			catch(int e)
-			{
-				//Delete the 'struct stat':
-				delete attr;
 
-				//Read the next entry:
-				dir_contents = readdir(dir);
-				continue;
-			}
+		//The run is counted before it is handed on, so whoever it is
+		//handed to sees every item read so far:
+		if(progress != NULL)
+			progress->items += offsets.size();
+		publish(makeRun(fd));
+		pool.clear();
+		offsets.clear();
+		if(size < (SIZE_MAX / 2))
+			size *= 2;
+
+		//Stops between runs if the read has been cancelled:
+		if((more) && (progress != NULL) && (! progress->check()))
+		{
+			int error = errno;
+			close(fd);
+			throw error;
 		}
-		//Delete the 'struct stat':
-		delete attr;
-	
-		//Add the file (or directory) to the list of files:
-		_files.push_back(file);
-
-		//Read the next entry:
-		dir_contents = readdir(dir);
 	}
+
 	//Close the directory:
-	closedir(dir);
+	close(fd);
 
-	//Sort the items:
-	std::sort(_files.begin(), _files.end(), byName);
+	//The room used for a huge directory is given back, rather than
+	//being kept for as long as the thread lasts:
+	if(scratch.attrs.capacity() > SCRATCH_LIMIT)
+		scratch = ReadScratch();
+}
 
-	//Count the dotfiles:
-	_dotfiles = 0;
-	for(unsigned int i = 0; i < _files.size(); i++)
-		if(_files[i]->getName()[0] == '.')
-			_dotfiles++;
+//Reads the first layer of files and directories in one run:
+void Directory::read()
+{
+	//The listing is emptied first in case the directory has been
+	//read before:
+	_listing.clear();
+	scan(SIZE_MAX, [this](Listing* run)
+		{
+			_listing.merge(*run);
+			delete run;
+		}, NULL);
 
-	//Finally, add a link to the parent dir at the front:
+	//Finally, add a link to the parent dir, before any items
+	//but after any dotfiles, so it is at the top of the items:
 	if(_path != "/")
-	{
-		DiskItem* parent = NULL;
-		std::string path = _path + "../";
+		_listing.addParent();
+}
 
-		//Attempt to create an object for the parent:
-		try
-		{
-			parent = new Directory(path.c_str());
-		}
-		catch(int e)
+//Reads the directory a run at a time, keeping each to be merged:
+void Directory::stream(const std::function <void()>& published, Progress* progress)
+{
+	scan(FIRST_RUN, [this, &published](Listing* run)
 		{
-			throw e;
-		}
+			{
+				std::lock_guard <std::mutex> guard(_lock);
+				_runs.push_back(run);
+			}
+			published();
+		}, progress);
+}
 
-		//Insert the link to the parent before any items but
-		//after any dotfiles, so it is at the top of the items:
-		_files.insert(_files.begin() + _dotfiles, parent);
+//Merges the runs read so far, adding the link to the parent with the first:
+bool Directory::merge(unsigned int& first)
+{
+	std::vector <Listing*> runs;
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		runs.swap(_runs);
+	}
+	if(runs.size() == 0)
+		return false;
+
+	first = _listing.getIds();
+	for(unsigned int i = 0; i < runs.size(); i++)
+	{
+		_listing.merge(*runs[i]);
+		delete runs[i];
 	}
+
+	if((first == 0) && (_path != "/"))
+		_listing.addParent();
+	return true;
 }
 
 //Calculates the size of a directory:
 void Directory::calcSize()
 {
-	//Get the base size of the directory:
-	_size = _attr->st_size;
+	calcSize(NULL);
+}
 
-	//Creates a pointer to a 'DIR' struct:
-	DIR* dir = opendir(_path.c_str());
-	if(dir == NULL)
-		throw errno;
+//Calculates the size of a directory, giving up early if cancelled.
+//The size comes from the cache if it is still up to date, otherwise
+//the walk is spread across the shared walker's threads:
+void Directory::calcSize(const std::atomic <bool>* cancelled)
+{
+	_size = SizeCache::shared().size(_path, cancelled);
+	_sized = true;
+}
 
-	//Creates a pointer to a 'dirent' struct:
-	dirent* dir_contents = readdir(dir);
+bool Directory::paste(std::string newpath, Progress* progress)
+{
+	//Only the size of the tree is known beforehand, if it has been sized:
+	if((progress != NULL) && (_sized))
+		progress->totalBytes = _size;
 
-	//While there is stuff to read:
-	while(dir_contents != 0)
+	//A cut item is only renamed, unless it is going to another filesystem:
+	if(_isCut)
 	{
-		//Get the name of the next item:
-		std::string name = dir_contents->d_name;
-
-		//Checks we are not reading ".":
-		if((name == ".") || (name == ".."))
-		{
-			//Read the next entry:
-			dir_contents = readdir(dir);
-			continue;
-		}
-
-		//The full path of the file:
-		std::string filepath = _path + name;
-
-		//Checks if the path is a directory or a file:
-		struct stat* attr = new struct stat;
-		if(stat(filepath.c_str(), attr) != 0)
-		{
-				//Delete the 'struct stat':
-				delete attr;
-
-				//Read the next entry:
-				dir_contents = readdir(dir);
-				continue;
-		}
-		
-		DiskItem* file = NULL;
-
-		//If it is a directory:
-		if(S_ISDIR(attr->st_mode) != 0)
-		{
-			//Attempt to open the directory:
-			try
-			{
-				file = new Directory(filepath.c_str());	
-
-				//Attempt to calculate the size:
-				file->calcSize();
-			}
-			catch(int e)
-			{
-				throw e;
-			}
-			//Get the directory's size:
-			_size += file->getSize();
-		}
-		else
-		{
-			//Attempt to open the file:
-			try
-			{
-				file = new File(filepath.c_str());
-			}
-			catch(int e)
-			{
-				throw e;
-			}
-			//Get the file's size:
-			_size += file->getSize();
-		}
-		//Read the next item:
-		dir_contents = readdir(dir);
-
-		//Delete the struct stat and the current object:
-		delete attr;
-		delete file;
+		if(move(newpath))
+			return true;
+		if(errno != EXDEV)
+			return false;
 	}
-	//Close the directory:
-	closedir(dir);
-}
 
-bool Directory::paste(std::string newpath)
-{
-	//If we have not read the directory's contents
-	//previously, read them now:
-	if(_files.size() == 0)
-		read();
-
-	//Creates a new directory in the new path:
-	std::string path = newpath + getName();
-	if(mkdir(path.c_str(), _attr->st_mode) != 0)
+	//Copies the directory and its contents to the new path, with
+	//the files copied on a pool of threads:
+	unsigned int threads = Walker::getThreads();
+	TreeCopier copier(((threads < 2) ? 2 : threads), progress);
+	if(! copier.copy(_path, (newpath + getName())))
 		return false;
 
-	//Copies the contents of the directory to
-	//the newly created directory:
-	for(unsigned int i = 0; i < _files.size(); i++)
-		if(_files[i]->getName() != "../")
-			if(! _files[i]->paste(path))
-				return false;
-
 	//If the file was set to cut, delete the contents
 	//and then delete the directory:
 	if(_isCut)
@@ -302,27 +302,29 @@ bool Directory::paste(std::string newpath)
 	return true;
 }
 
-bool Directory::deletef()
+bool Directory::deletef(Progress* progress)
 {
-	//If we have not read the directory's contents
-	//previously, read them now:
-	if(_files.size() == 0)
-		read();
-
-	//Deletes the files and directories contained
-	//in the directory:
-	for(unsigned int i = 0; i < _files.size(); i++)
+	//A link to a directory is deleted itself, rather than
+	//everything in the directory it links to:
+	std::string path = _path.substr(0, (_path.size() - 1));
+	struct stat attr;
+	if((lstat(path.c_str(), &attr) == 0) && (S_ISLNK(attr.st_mode) != 0))
 	{
-		if(_files[i]->getName() != "../")
-			if(! _files[i]->deletef())
-				return false;
-	}
+		if(unlink(path.c_str()) != 0)
+			return false;
 
-	//Deletes the now empty directory:
-	if(rmdir(_path.c_str()) != 0)
-		return false;
+		if(progress != NULL)
+			progress->items++;
+		return true;
+	}
 
-	return true; 
+	//Deletes the files and directories contained in the
+	//directory, then the directory itself, without reading
+	//anything more than the names and types of its contents.
+	//It is opened without following links, so a link swapped
+	//in for it since the check above is never followed:
+	TreeDeleter deleter(progress);
+	return deleter.remove(_path);
 }
 
 //Say the directory path is '/home/alex/Code/trilobite/../'.
@@ -341,6 +343,44 @@ void Directory::cleanPath()
 	_path = _path.substr(0, (pos2 + 1));
 }
 
+//Adds the named item in the directory to the listing, keeping it sorted:
+unsigned int Directory::insert(const std::string& name)
+{
+	std::string path = _path + name;
+	struct stat attr;
+	if(stat(path.c_str(), &attr) != 0)
+		throw errno;
+
+	return _listing.insert(name.c_str(), attr);
+}
+
+//Creates a File or Directory for the item at the given place in the listing:
+DiskItem* Directory::getItem(unsigned int index)
+{
+	std::string path = getItemPath(_listing.getId(index));
+	struct stat attr;
+	if(stat(path.c_str(), &attr) != 0)
+		return NULL;
+
+	DiskItem* item = NULL;
+	if(S_ISDIR(attr.st_mode) != 0)
+		item = new Directory(path, attr);
+	else
+		item = new File(path, attr);
+
+	//Keeps a size that has already been calculated:
+	if(_listing.isSized(_listing.getId(index)))
+		item->setSize(_listing.getSize(_listing.getId(index)));
+
+	return item;
+}
+
+//Returns the full path of the item with the given id:
+std::string Directory::getItemPath(unsigned int id)
+{
+	return _path + _listing.getName(id);
+}
+
 std::string Directory::getName()
 {
 	//Gets the position of the second to last '/', as
@@ -352,14 +392,8 @@ std::string Directory::getName()
 	return _path.substr(pos + 1);
 }
 
-//Returns the list of files and directories:
-std::vector <DiskItem*>& Directory::getFiles()
-{
-	return _files;
-}
-
-//Returns the number of dotfiles in this directory:
-unsigned int Directory::getDotfiles()
+//Returns the listing of the items in the directory:
+Listing& Directory::getListing()
 {
-	return _dotfiles;
+	return _listing;
 }
@@ -2,50 +2,100 @@
 // directory.h
 //
 // Contains the class definition for
-// a directory, a collection of DiskItems.
+// a directory, which keeps a listing of
+// the items it contains. A directory can
+// be read all at once, or streamed a run
+// at a time, so the first of a huge one
+// can be shown before the rest is read.
 // ---
 
 #ifndef DIRECTORY_H
 #define DIRECTORY_H
 #include "diskItem.h"
+#include "listing.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
 #include <vector>
 
 class Directory : public DiskItem
 {
 	private:
 		//The files the directory contains:
-		std::vector <DiskItem*> _files;
+		Listing _listing;
 
-		//The number of dotfiles in the directory:
-		unsigned int _dotfiles;
+		//The runs streamed but not yet merged into the listing, and
+		//the lock guarding them:
+		std::vector <Listing*> _runs;
+		std::mutex _lock;
+
+		//Reads the items in runs, each sorted, passing each to the
+		//function given, starting with a run of the size given, and
+		//doubling it each time. Throws errno if the directory cannot
+		//be read, or the read is cancelled:
+		void scan(size_t, const std::function <void(Listing*)>&, Progress*);
 
 	public:
+		//The most items in the first run streamed:
+		static const size_t FIRST_RUN = 1024;
+
 		//Default constructor, takes a filename:
 		Directory(const char*);
 
-		//Takes a pointer to a directory object, creates a copy:
-		Directory(Directory*);
+		//Takes a path and the attributes already read for it:
+		Directory(const std::string&, const struct stat&);
 
 		//Destructor:
 		~Directory();
 
-		//Reads the contents of the directory:
+		//Reads the contents of the directory, without
+		//calculating the sizes of any subdirectories:
 		void read();
 
+		//Reads the contents of the directory a run at a time, on the
+		//calling thread, calling the function given as each run is
+		//ready to merge. The items read are counted in the progress,
+		//which is checked between runs. Throws errno if the directory
+		//cannot be read, or the read is cancelled:
+		void stream(const std::function <void()>&, Progress* = NULL);
+
+		//Merges the runs streamed so far into the listing, adding the
+		//link to the parent with the first. Returns false if there were
+		//none, otherwise sets the first id given to the items merged:
+		bool merge(unsigned int&);
+
 		//Calculates the size of the directory:
 		void calcSize();
 
-		//Directory operation functions:
-		bool paste(std::string);
-		bool deletef();
+		//Calculates the size of the directory, giving up by
+		//throwing ECANCELED if the flag passed becomes true:
+		void calcSize(const std::atomic <bool>*);
+
+		//Directory operation functions. Each counts what it has done
+		//in the progress passed, if there is one:
+		bool paste(std::string, Progress* = NULL);
+		bool deletef(Progress* = NULL);
 
 		//Cleans the path to remove trailing '../':
 		void cleanPath();
 
+		//Adds the named item in the directory to the listing, keeping
+		//it sorted, and returns its id. Throws errno if it cannot be
+		//stat'ed:
+		unsigned int insert(const std::string&);
+
+		//Creates a File or Directory for the item at the given place
+		//in the listing, to perform operations on, which the caller
+		//deletes. Returns NULL if it cannot be stat'ed:
+		DiskItem* getItem(unsigned int);
+
+		//Returns the full path of the item with the given id:
+		std::string getItemPath(unsigned int);
+
 		//Getters:
 		std::string getName();
-		std::vector <DiskItem*>& getFiles();
-		unsigned int getDotfiles();
+		Listing& getListing();
 };
 
 #endif
@@ -3,7 +3,9 @@
 #include <sstream>
 #include <cstdio>
 #include <cctype>
+#include <cerrno>
 #include <cmath>
+#include <fcntl.h>
 
 //Marks the DiskItem as cut:
 void DiskItem::cut()
@@ -27,19 +29,95 @@ bool DiskItem::rename(const char* newname)
 	return true;
 }
 
+//Renames the cut item into the new directory, never replacing anything:
+bool DiskItem::move(const std::string& newpath)
+{
+	//Only an item on the same filesystem can be renamed there:
+	struct stat attr;
+	if(stat(newpath.c_str(), &attr) != 0)
+		return false;
+	if(attr.st_dev != _attr.st_dev)
+	{
+		errno = EXDEV;
+		return false;
+	}
+
+	//Directory names end in a '/', which is left off:
+	std::string name = getName();
+	if(name[name.size() - 1] == '/')
+		name.erase(name.size() - 1);
+	std::string from = _path;
+	if(from[from.size() - 1] == '/')
+		from.erase(from.size() - 1);
+	std::string to = newpath + name;
+
+	if(! moveItem(AT_FDCWD, from, AT_FDCWD, to, from, to))
+		return false;
+
+	_path = newpath + getName();
+	return true;
+}
+
+//Renames the item, never replacing anything already there:
+bool moveItem(int fromDir, const std::string& fromName, int toDir, const std::string& toName,
+	const std::string& from, const std::string& to)
+{
+	if(renameat2(fromDir, fromName.c_str(), toDir, toName.c_str(), RENAME_NOREPLACE) == 0)
+		return true;
+
+	//Some filesystems cannot be told not to replace anything, so if
+	//there is nothing there, and the item is not being moved inside
+	//itself, it is renamed without:
+	struct stat attr;
+	if((errno == EINVAL) && (to.compare(0, (from.size() + 1), (from + '/')) != 0) &&
+		(fstatat(toDir, toName.c_str(), &attr, AT_SYMLINK_NOFOLLOW) != 0) && (errno == ENOENT))
+		return (renameat(fromDir, fromName.c_str(), toDir, toName.c_str()) == 0);
+
+	return false;
+}
+
 //Returns the path:
 std::string DiskItem::getPath()
 {
 	return _path;
 }
 
+const struct stat& DiskItem::getAttributes()
+{
+	return _attr;
+}
+
 //Returns the filesize:
-unsigned int DiskItem::getSize()
+unsigned long long DiskItem::getSize()
 {
 	return _size;
 }
+
+//Returns true if the size has been calculated:
+bool DiskItem::isSized()
+{
+	return _sized;
+}
+
+//Sets the size once it has been calculated:
+void DiskItem::setSize(unsigned long long size)
+{
+	_size = size;
+	_sized = true;
+}
  
 std::string DiskItem::getFormattedSize()
+{
+	//Directory sizes are filled in by the sizer, so
+	//may not be known yet:
+	if(! _sized)
+		return "calculating...";
+
+	return formatSize(_size);
+}
+
+//Returns a string with the size and an appropriate unit:
+std::string formatSize(unsigned long long size)
 {
 	//The formatted string, set to use zero
 	//decimal places and 'fixed' notation (as
@@ -49,32 +127,32 @@ std::string DiskItem::getFormattedSize()
 	formatted.setf(std::ios::fixed);
 
 	//Checks if the size is in bytes:
-	if((_size / pow(2, 10)) < 1)
+	if((size / pow(2, 10)) < 1)
 	{
-		formatted << _size << "B";
+		formatted << size << "B";
 	}
 	//Checks if the size is in kilobytes:
-	else if((_size / pow(2, 20)) < 1)
+	else if((size / pow(2, 20)) < 1)
 	{
-		float newSize = (_size / pow(2, 10));
+		float newSize = (size / pow(2, 10));
 		formatted << newSize << "kB";
 	}
 	//Checks if the size is in megabytes:
-	else if((_size / pow(2, 30)) < 1)
+	else if((size / pow(2, 30)) < 1)
 	{
-		float newSize = (_size / pow(2, 20));
+		float newSize = (size / pow(2, 20));
 		formatted << newSize << "MB";
 	}
 	//Checks if the size is in gigabytes:
-	else if((_size / pow(2, 40)) < 1)
+	else if((size / pow(2, 40)) < 1)
 	{
-		float newSize = (_size / pow(2, 30));
+		float newSize = (size / pow(2, 30));
 		formatted << newSize << "GB";
 	}
 	//Checks if the size is in terabytes:
-	else if((_size / pow(2, 50)) < 1)
+	else if((size / pow(2, 50)) < 1)
 	{
-		float newSize = (_size / pow(2, 40));
+		float newSize = (size / pow(2, 40));
 		formatted << newSize << "TB";
 	}
 	return formatted.str();
@@ -90,7 +168,7 @@ bool byName(DiskItem* A, DiskItem* B)
 	if((a[0] == '.') && (b[0] == '.'))
 	{
 		//If they both are, sort by name:
-		if(lowercase(a) < lowercase(a))
+		if(lowercase(a) < lowercase(b))
 			return true;
 		else
 			return false;
@@ -116,3 +194,51 @@ std::string lowercase(std::string s)
 		out += tolower(s[i]);
 	return out;
 }
+
+//Takes a directory path and returns it shrunk to the given size or smaller:
+std::string fitToSize(std::string path, unsigned int size)
+{
+	//The position in the string, starts at 1 to skip the first '/':
+	int pos = 1;
+	while(path.length() > size)
+	{
+		//Gets the directory name between the '/':
+		int newPos = path.find('/', pos);
+		std::string dir = path.substr(pos, (newPos - pos));
+
+		//The characters removed, minus 1 for the '/':
+		int removed = dir.length() - 2;
+
+		//Replace the directory name with the first letter:
+		dir = dir[0];
+
+		//Grabs the bit of the path before and after the edit to build the string:
+		std::string front = path.substr(0, pos);
+		std::string back = path.substr(newPos, (path.size() - newPos));
+		path = (front + dir + back);
+
+		pos = newPos - removed;
+	}
+	return path;
+}
+
+//Quotes the string, escaping what JSON needs escaped:
+std::string quote(const std::string& text)
+{
+	std::string quoted = "\"";
+	for(unsigned int i = 0; i < text.size(); i++)
+	{
+		unsigned char c = text[i];
+		if((c == '"') || (c == '\\'))
+			quoted += std::string("\\") + (char)c;
+		else if(c < 0x20)
+		{
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			quoted += escaped;
+		}
+		else
+			quoted += (char)c;
+	}
+	return quoted + "\"";
+}
@@ -8,6 +8,7 @@
 
 #ifndef DISK_ITEM_H
 #define DISK_ITEM_H
+#include "progress.h"
 #include <string>
 #include <sys/stat.h>
 
@@ -15,10 +16,17 @@ class DiskItem
 {
 	protected:
 		std::string _path;
-		unsigned int _size;
-		struct stat* _attr;
+		unsigned long long _size;
+		bool _sized;
+		struct stat _attr;
 		bool _isCut;
 
+		//Moves a cut item into the passed directory by renaming it,
+		//if they are on the same filesystem, which takes the same time
+		//whatever its size. Returns false with errno set to EXDEV if
+		//they are not, and the item has to be copied instead:
+		bool move(const std::string&);
+
 	public:
 		//Virtual destructor:
 		virtual ~DiskItem() { }
@@ -28,18 +36,24 @@ class DiskItem
 
 		//Operation functions:
 		void cut();
-		virtual bool paste(std::string) = 0;
-		virtual bool deletef() = 0;
+		virtual bool paste(std::string, Progress* = NULL) = 0;
+		virtual bool deletef(Progress* = NULL) = 0;
 		bool rename(const char*);
 
 		//Returns a string with the filesize and
-		//an appropriate unit:
+		//an appropriate unit, or a placeholder if
+		//it is still being calculated:
 		std::string getFormattedSize();
 
+		//Sets the size once it has been calculated:
+		void setSize(unsigned long long);
+
 		//Getters:
 		std::string getPath();
+		const struct stat& getAttributes();
 		virtual std::string getName() = 0;
-		unsigned int getSize();
+		unsigned long long getSize();
+		bool isSized();
 };
 
 //Checks the names of the two items passed,
@@ -48,6 +62,22 @@ class DiskItem
 //from the standard 'algorithm' library:
 bool byName(DiskItem*, DiskItem*);
 
+//Returns a string with the passed size and an appropriate unit:
+std::string formatSize(unsigned long long);
+
+//Takes a directory path, and returns it shrunk to fit the size:
+std::string fitToSize(std::string path, unsigned int size);
+
+//Renames the item with the first name, relative to the first open
+//directory, to the second name, relative to the second, either of
+//which may be AT_FDCWD. The item's path and the path it is moved to
+//are given, so it is never moved inside itself. Never replaces anything,
+//and returns false with errno set, to EXDEV if it has to be copied:
+bool moveItem(int, const std::string&, int, const std::string&, const std::string&, const std::string&);
+
+//Returns the string quoted for JSON:
+std::string quote(const std::string&);
+
 //Takes a string an returns the lowercase variant:
 std::string lowercase(std::string);
 
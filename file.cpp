@@ -1,23 +1,26 @@
 // --- file.cpp
 #include "file.h"
-#include <fstream>
+#include "copier.h"
+#include "stats.h"
 #include <cstdio>
 #include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 File::File(const char* path)
 {
 	//Reads the file's attributes into '_attr':
-	_attr = new struct stat;
-	if(stat(path, _attr) != 0)
+	if(stat(path, &_attr) != 0)
 		throw errno;
 
 	//Checks the passed file is not a directory:
-	if(S_ISDIR(_attr->st_mode) != 0)
+	if(S_ISDIR(_attr.st_mode) != 0)
 		throw errno;
 
 	//Gets the size:
-	_size = _attr->st_size;
+	_size = _attr.st_size;
+	_sized = true;
 
 	//Saves the filename:
 	_path = path;
@@ -25,45 +28,84 @@ File::File(const char* path)
 	_isCut = false;
 }
 
-File::File(File* file)
+File::File(const std::string& path, const struct stat& attr)
 {
-	//Copies the passed file's data:
-	_size = file->getSize();
-	_path = file->getPath();
+	_attr = attr;
+	_size = _attr.st_size;
+	_sized = true;
+	_path = path;
 	_isCut = false;
-
-	//Reads the file's attributes into '_attr':
-	_attr = new struct stat;
-	if(stat(_path.c_str(), _attr) != 0)
-		throw errno;
 }
 
 File::~File()
 {
-	//Deletes the stat struct:
-	delete _attr;
 }
 
 //Creates a copy of the file in the passed location:
-bool File::paste(std::string newpath)
+bool File::paste(std::string newpath, Progress* progress)
 {
+	Stats::Span span(Stats::PASTE);
+
+	if(progress != NULL)
+	{
+		progress->totalItems = 1;
+		progress->totalBytes = _attr.st_size;
+	}
+
+	//A cut item is only renamed, unless it is going to another filesystem:
+	if(_isCut)
+	{
+		if(move(newpath))
+		{
+			if(progress != NULL)
+			{
+				progress->items++;
+				progress->bytes += _attr.st_size;
+			}
+			return true;
+		}
+		if(errno != EXDEV)
+			return false;
+	}
+
 	//Opens an input file:
-	std::ifstream in(_path.c_str(), std::ios::binary);
+	int in = open(_path.c_str(), (O_RDONLY | O_CLOEXEC));
+	if(in < 0)
+		return false;
 
 	//Opens an output file:
 	std::string path = newpath + getName();
-	std::ofstream out(path.c_str(), std::ios::binary);
-
-	//If either cannot be opened:
-	if((! in) || (! out))
+	int out = open(path.c_str(), (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC), 0666);
+	if(out < 0)
+	{
+		close(in);
 		return false;
+	}
 
-	//Writes the input file to the output file:
-	out << in.rdbuf();
+	//Copies the input file to the output file, letting the kernel
+	//do it where it can:
+	Copier::Method method = Copier::CLONE;
+	bool copied = Copier::copy(in, out, method, progress);
 
 	//Closes the files:
-	in.close();
-	out.close();
+	int error = errno;
+	close(in);
+	if((close(out) != 0) && (copied))
+	{
+		error = errno;
+		copied = false;
+	}
+
+	//A cancelled copy is not left half done:
+	if(! copied)
+	{
+		if(error == ECANCELED)
+			unlink(path.c_str());
+		errno = error;
+		return false;
+	}
+	if(progress != NULL)
+		progress->items++;
 
 	//If we are cutting the file, delete the original:
 	if(_isCut)
@@ -71,7 +113,7 @@ bool File::paste(std::string newpath)
 			return false;
 
 	//Get the original's permission bits:
-	mode_t permission = _attr->st_mode;
+	mode_t permission = _attr.st_mode;
 
 	//Attempts to write the original permission bits:
 	if(chmod(path.c_str(), permission) != 0)
@@ -80,12 +122,14 @@ bool File::paste(std::string newpath)
 	return true;
 }
 
-bool File::deletef()
+bool File::deletef(Progress* progress)
 {
 	//Removes the file, if it cannot, returns false:
 	if(remove(_path.c_str()) != 0)
 		return false;
 
+	if(progress != NULL)
+		progress->items++;
 	return true;
 }
 
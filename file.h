@@ -19,8 +19,8 @@ class File : public DiskItem
 		//Defualt constructor, takes a filename:
 		File(const char*);
 
-		//Takes a pointer to a file object, creates a copy:
-		File(File*);
+		//Takes a path and the attributes already read for it:
+		File(const std::string&, const struct stat&);
 
 		//Destructor:
 		~File();
@@ -28,8 +28,8 @@ class File : public DiskItem
 		void calcSize() { }
 
 		//File operation functions:
-		bool paste(std::string);
-		bool deletef();
+		bool paste(std::string, Progress* = NULL);
+		bool deletef(Progress* = NULL);
 
 		//Getters:
 		std::string getName();
@@ -0,0 +1,280 @@
+// --- filter.cpp
+#include "filter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fnmatch.h>
+#include <strings.h>
+
+//The names of the modes, as they are shown:
+static const char* NAMES[] = { "text", "glob", "fuzzy" };
+
+//The most a gap before a letter matched fuzzily counts against it:
+static const int MAX_GAP = 8;
+
+//Text is only looked for again in the items it matched before if they
+//are fewer than one in this many of the listing:
+static const unsigned int NARROW_RATIO = 16;
+
+//Returns true if the second character starts a word in a name:
+static bool isBoundary(unsigned char before, unsigned char c)
+{
+	if((before == ' ') || (before == '.') || (before == '_') || (before == '-'))
+		return true;
+	if((islower(before)) && (isupper(c)))
+		return true;
+	return ((! isdigit(before)) && (isdigit(c)));
+}
+
+Filter::Filter()
+{
+	_listing = NULL;
+	_version = 0;
+	_mode = SUBSTRING;
+	_failed = false;
+}
+
+void Filter::show(Listing* listing)
+{
+	_listing = listing;
+	clear();
+}
+
+void Filter::clear()
+{
+	_query.clear();
+	_matches.clear();
+	_rows.clear();
+	_failed = false;
+}
+
+//A query which starts with the last one can only match fewer items, so
+//only those which matched it are looked at, unless the listing has
+//changed. A glob can match more as it gets longer, so is always matched
+//against the whole listing, and so is text if most items matched, as
+//searching every name at once is quicker than looking at each of them:
+bool Filter::set(const std::string& query, Mode mode)
+{
+	if((_listing == NULL) || (query.empty()))
+	{
+		clear();
+		_mode = mode;
+		return true;
+	}
+
+	bool narrowing = ((isActive()) && (mode == _mode) && (mode != GLOB) &&
+		(_version == _listing->getVersion()) && (query.compare(0, _query.size(), _query) == 0));
+	if((mode == SUBSTRING) && ((_matches.size() * NARROW_RATIO) > _listing->size()))
+		narrowing = false;
+	_query = query;
+	_mode = mode;
+	_failed = (! match(narrowing ? &_matches : NULL));
+	return (! _failed);
+}
+
+void Filter::update()
+{
+	if((! isActive()) || (_listing == NULL) || (_version == _listing->getVersion()))
+		return;
+	if(! match(NULL))
+		clear();
+}
+
+//Text is searched for across every name at once first, and a fuzzy query
+//only looks closer at the names with its first letter in them:
+bool Filter::match(const std::vector <uint32_t>* candidates)
+{
+	//Case is only matched if the query has capitals:
+	bool fold = true;
+	for(unsigned int i = 0; i < _query.size(); i++)
+		if(isupper((unsigned char)_query[i]))
+			fold = false;
+
+	std::vector <uint32_t> ids;
+	bool searched = false;
+	if(candidates == NULL)
+	{
+		if(_mode != GLOB)
+		{
+			_listing->search(((_mode == SUBSTRING) ? _query : _query.substr(0, 1)), fold, _found);
+			searched = true;
+		}
+		for(unsigned int i = _listing->getDotfiles(); i < _listing->size(); i++)
+		{
+			unsigned int id = _listing->getId(i);
+			if((! _listing->isParent(id)) && ((! searched) || (_found[id] != 0)))
+				ids.push_back(id);
+		}
+		candidates = &ids;
+	}
+
+	std::vector <uint32_t> matches;
+	std::vector <std::pair <int, uint32_t> > scores;
+	for(unsigned int i = 0; i < candidates->size(); i++)
+	{
+		unsigned int id = (*candidates)[i];
+		const char* name = _listing->getRawName(id);
+		switch(_mode)
+		{
+			case SUBSTRING:
+				if((searched) || ((fold) ? (strcasestr(name, _query.c_str()) != NULL) : (strstr(name, _query.c_str()) != NULL)))
+					matches.push_back(id);
+				break;
+
+			case GLOB:
+				if(fnmatch(_query.c_str(), name, ((fold) ? FNM_CASEFOLD : 0)) == 0)
+					matches.push_back(id);
+				break;
+
+			case FUZZY:
+			{
+				int closeness = score(name, _query, fold);
+				if(closeness >= 0)
+				{
+					matches.push_back(id);
+					scores.push_back(std::make_pair(closeness, id));
+				}
+				break;
+			}
+		}
+	}
+
+	if(matches.empty())
+		return false;
+
+	_matches.swap(matches);
+	_version = _listing->getVersion();
+	if(_mode != FUZZY)
+	{
+		_rows = _matches;
+		return true;
+	}
+
+	//The closest matches go first, and equally close ones stay in order:
+	std::stable_sort(scores.begin(), scores.end(),
+		[](const std::pair <int, uint32_t>& a, const std::pair <int, uint32_t>& b) { return (a.first > b.first); });
+	_rows.resize(scores.size());
+	for(unsigned int i = 0; i < scores.size(); i++)
+		_rows[i] = scores[i].second;
+	return true;
+}
+
+//Matches each letter of the query at the first place it is found after
+//the last. Each letter matched scores, more so if it follows straight on
+//from the last, or starts a word, and less so the further it is from it:
+int Filter::score(const char* name, const std::string& query, bool fold)
+{
+	int total = 0;
+	int last = -1;
+	unsigned int matched = 0;
+	for(int i = 0; (name[i] != '\0') && (matched < query.size()); i++)
+	{
+		unsigned char c = name[i];
+		if((fold) && (c < 0x80))
+			c = tolower(c);
+		if(c != (unsigned char)query[matched])
+			continue;
+
+		total += 16;
+		if((matched > 0) && (i == (last + 1)))
+			total += 16;
+		if((i == 0) || (isBoundary(name[i - 1], name[i])))
+			total += 8;
+		total -= std::min((i - last) - 1, MAX_GAP);
+
+		last = i;
+		matched++;
+	}
+
+	if(matched < query.size())
+		return -1;
+	return std::max(total, 0);
+}
+
+unsigned int Filter::size()
+{
+	if(_listing == NULL)
+		return 0;
+	if(! isActive())
+		return (_listing->size() - _listing->getDotfiles());
+	return _rows.size();
+}
+
+unsigned int Filter::getId(unsigned int row)
+{
+	if(! isActive())
+		return _listing->getId(row + _listing->getDotfiles());
+	return _rows[row];
+}
+
+unsigned int Filter::indexOf(unsigned int id, unsigned int hint)
+{
+	if(! isActive())
+	{
+		unsigned int dotfiles = _listing->getDotfiles();
+		unsigned int index = _listing->indexOf(id, (hint + dotfiles));
+		if((index < dotfiles) || (index >= _listing->size()))
+			return size();
+		return (index - dotfiles);
+	}
+
+	if((hint < _rows.size()) && (_rows[hint] == id))
+		return hint;
+	return (std::find(_rows.begin(), _rows.end(), id) - _rows.begin());
+}
+
+//The rows are in the order of the listing, unless matched fuzzily, so
+//are searched in halves by their sort keys, looking at only a few of
+//them however many there are. Fuzzy matches are in order of closeness,
+//so are looked through from the top for the first name starting with it:
+unsigned int Filter::seek(const std::string& prefix)
+{
+	if(size() == 0)
+		return 0;
+
+	if((isActive()) && (_mode == FUZZY))
+	{
+		for(unsigned int i = 0; i < _rows.size(); i++)
+			if(strncasecmp(_listing->getRawName(_rows[i]), prefix.c_str(), prefix.size()) == 0)
+				return i;
+		return (_rows.size() - 1);
+	}
+
+	std::string key;
+	Listing::makeKey(prefix.c_str(), false, key);
+	unsigned int low = 0, high = size();
+	while(low < high)
+	{
+		unsigned int middle = low + ((high - low) / 2);
+		if(_listing->isBefore(getId(middle), key))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return std::min(low, (size() - 1));
+}
+
+const char* Filter::getName(Mode mode)
+{
+	return NAMES[mode];
+}
+
+bool Filter::isActive()
+{
+	return (! _query.empty());
+}
+
+bool Filter::hasFailed()
+{
+	return _failed;
+}
+
+const std::string& Filter::getQuery()
+{
+	return _query;
+}
+
+Filter::Mode Filter::getMode()
+{
+	return _mode;
+}
@@ -0,0 +1,105 @@
+// ---
+// filter.h
+//
+// Contains the class definition for the
+// filter, the rows of a listing that are
+// shown: every item but the dotfiles, or
+// while there is a query, only the items
+// whose names match it. A query can match
+// as text anywhere in the name, as a glob
+// pattern, or fuzzily, with the letters
+// in order but not together, where the
+// closest matches are shown first. Case
+// is ignored unless the query has capitals.
+// Typing more of a query only looks again
+// at the items which matched before.
+// ---
+
+#ifndef FILTER_H
+#define FILTER_H
+#include "listing.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class Filter
+{
+	public:
+		//The ways a query can match:
+		enum Mode { SUBSTRING, GLOB, FUZZY };
+		static const unsigned int MODES = 3;
+
+	private:
+		//The listing filtered, and its version when it last was:
+		Listing* _listing;
+		unsigned int _version;
+
+		//The query, and how it matches:
+		std::string _query;
+		Mode _mode;
+
+		//The items matching, in the order of the listing, and in the
+		//order they are shown, which only differs for fuzzy matches:
+		std::vector <uint32_t> _matches;
+		std::vector <uint32_t> _rows;
+
+		//Set if the query matched nothing, in which case the rows from
+		//the query before are kept:
+		bool _failed;
+
+		//Room reused for each search of the whole listing:
+		std::vector <uint8_t> _found;
+
+		//Finds the items matching the query among those given, or in the
+		//whole listing if there are none. Returns false if none match:
+		bool match(const std::vector <uint32_t>*);
+
+		//Returns how closely the name matches the query fuzzily, higher
+		//being closer, or -1 if it does not:
+		static int score(const char*, const std::string&, bool);
+
+	public:
+		//Default constructor, nothing is filtered:
+		Filter();
+
+		//Shows every item in the listing given, taking away any query:
+		void show(Listing*);
+
+		//Shows only the items matching the query, in the mode given.
+		//Returns false, keeping the rows shown, if none match:
+		bool set(const std::string&, Mode);
+
+		//Takes away the query, showing every item again:
+		void clear();
+
+		//Matches the query again if the listing has changed, taking it
+		//away if nothing matches any more:
+		void update();
+
+		//Returns the number of rows shown:
+		unsigned int size();
+
+		//Returns the id of the item on the given row:
+		unsigned int getId(unsigned int);
+
+		//Returns the row the item with the given id is on, or 'size()'
+		//if it is not shown. The row it was last seen on can be passed,
+		//and is checked first:
+		unsigned int indexOf(unsigned int, unsigned int = 0);
+
+		//Returns the first row whose name sorts at or after the prefix
+		//given, which is the first starting with it if any do, or the
+		//last row if every name sorts before it:
+		unsigned int seek(const std::string&);
+
+		//Returns the name of the mode given:
+		static const char* getName(Mode);
+
+		//Getters:
+		bool isActive();
+		bool hasFailed();
+		const std::string& getQuery();
+		Mode getMode();
+};
+
+#endif
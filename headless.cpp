@@ -0,0 +1,295 @@
+// --- headless.cpp
+#include "headless.h"
+#include "directory.h"
+#include "file.h"
+#include "notifier.h"
+#include "progress.h"
+#include "sizer.h"
+#include "stats.h"
+#include "walker.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/stat.h>
+
+Headless::Headless(bool json)
+{
+	_json = json;
+	_failed = false;
+}
+
+bool Headless::isOperation(const std::string& arg)
+{
+	return ((arg == "--ls") || (arg == "--du") || (arg == "--cp") || (arg == "--mv") || (arg == "--rm"));
+}
+
+int Headless::run(const std::string& operation, const std::vector <std::string>& paths)
+{
+	if(paths.empty())
+	{
+		std::cerr << "Please pass a path to " << operation.substr(2) << std::endl;
+		return 2;
+	}
+
+	if(operation == "--ls")
+	{
+		for(unsigned int i = 0; i < paths.size(); i++)
+			list(paths[i]);
+	}
+	else if(operation == "--du")
+		total(paths);
+	else if((operation == "--cp") || (operation == "--mv"))
+	{
+		if(paths.size() < 2)
+		{
+			std::cerr << "Please pass the items to " << operation.substr(2) << ", then where to" << std::endl;
+			return 2;
+		}
+		copy(paths, (operation == "--mv"));
+	}
+	else if(operation == "--rm")
+		remove(paths);
+
+	std::cout.flush();
+	return (_failed ? 1 : 0);
+}
+
+//Waits for the sizer to finish something, noting each size, or the error
+//for anything that could not be sized:
+static void collect(Sizer& sizer, Notifier& notifier, std::vector <bool>& sized,
+	std::vector <unsigned long long>& sizes, std::vector <int>& errors)
+{
+	std::vector <Sizer::Result> results;
+	while(! sizer.collect(results))
+	{
+		struct pollfd event = { notifier.getFd(), POLLIN, 0 };
+		poll(&event, 1, ((event.fd < 0) ? 10 : -1));
+		notifier.clear();
+	}
+
+	for(unsigned int i = 0; i < results.size(); i++)
+	{
+		if((! results[i].relative) && (results[i].id < sized.size()))
+		{
+			sized[results[i].id] = true;
+			sizes[results[i].id] = results[i].size;
+			errors[results[i].id] = results[i].error;
+		}
+	}
+}
+
+//Lists the directory in order, printing each item as soon as it, and
+//every item before it, has been sized:
+void Headless::list(const std::string& path)
+{
+	Directory* dir = NULL;
+	try
+	{
+		dir = new Directory(path.c_str());
+		dir->read();
+	}
+	catch(int e)
+	{
+		delete dir;
+		fail("ls", path, e);
+		return;
+	}
+
+	//Every subdirectory is sized at once, across the workers:
+	Listing& items = dir->getListing();
+	Notifier notifier;
+	Sizer sizer(Walker::getThreads(), &notifier);
+	std::vector <bool> sized(items.getIds(), false);
+	std::vector <unsigned long long> sizes(items.getIds(), 0);
+	std::vector <int> errors(items.getIds(), 0);
+	for(unsigned int i = 0; i < items.size(); i++)
+	{
+		unsigned int id = items.getId(i);
+		if(items.isParent(id))
+			sized[id] = true;
+		else if(items.isSized(id))
+		{
+			sized[id] = true;
+			sizes[id] = items.getSize(id);
+		}
+		else
+			sizer.request(id, dir->getItemPath(id));
+	}
+
+	for(unsigned int i = 0; i < items.size(); i++)
+	{
+		unsigned int id = items.getId(i);
+		while(! sized[id])
+			collect(sizer, notifier, sized, sizes, errors);
+		if(items.isParent(id))
+			continue;
+		if(errors[id] != 0)
+		{
+			fail("ls", dir->getItemPath(id), errors[id]);
+			continue;
+		}
+
+		if(_json)
+		{
+			char mode[16];
+			snprintf(mode, sizeof(mode), "%04o", (items.getMode(id) & 07777));
+			std::cout << "{\"name\":" << quote(items.getRawName(id))
+				<< ",\"type\":\"" << (items.isDirectory(id) ? "directory" : "file")
+				<< "\",\"size\":" << sizes[id]
+				<< ",\"mode\":\"" << mode
+				<< "\",\"mtime\":" << items.getMtime(id) << "}\n";
+		}
+		else
+			std::cout << sizes[id] << '\t' << items.getName(id) << '\n';
+	}
+
+	delete dir;
+}
+
+//Sizes every tree at once, printing each total in the order given as
+//soon as it, and every one before it, is ready:
+void Headless::total(const std::vector <std::string>& paths)
+{
+	Notifier notifier;
+	Sizer sizer(Walker::getThreads(), &notifier);
+	std::vector <bool> sized(paths.size(), false);
+	std::vector <unsigned long long> sizes(paths.size(), 0);
+	std::vector <int> errors(paths.size(), 0);
+	for(unsigned int i = 0; i < paths.size(); i++)
+	{
+		struct stat attr;
+		if(stat(paths[i].c_str(), &attr) != 0)
+		{
+			errors[i] = errno;
+			sized[i] = true;
+		}
+		else if(S_ISDIR(attr.st_mode) == 0)
+		{
+			sizes[i] = attr.st_size;
+			sized[i] = true;
+		}
+		else
+			sizer.request(i, paths[i]);
+	}
+
+	for(unsigned int i = 0; i < paths.size(); i++)
+	{
+		while(! sized[i])
+			collect(sizer, notifier, sized, sizes, errors);
+
+		if(errors[i] != 0)
+			fail("du", paths[i], errors[i]);
+		else if(_json)
+			std::cout << "{\"path\":" << quote(paths[i]) << ",\"size\":" << sizes[i] << "}\n";
+		else
+			std::cout << sizes[i] << '\t' << paths[i] << '\n';
+		std::cout.flush();
+	}
+}
+
+//Pastes each item into the directory, one after another, with the trees
+//copied across the workers:
+void Headless::copy(const std::vector <std::string>& paths, bool move)
+{
+	const char* operation = (move ? "mv" : "cp");
+	std::string to = paths.back();
+	if(to[to.size() - 1] != '/')
+		to += '/';
+
+	//The error is given once, for the destination, rather than for
+	//every item it could not be pasted into:
+	struct stat attr;
+	if(stat(to.c_str(), &attr) != 0)
+	{
+		fail(operation, paths.back(), errno);
+		return;
+	}
+	if(S_ISDIR(attr.st_mode) == 0)
+	{
+		fail(operation, paths.back(), ENOTDIR);
+		return;
+	}
+
+	for(unsigned int i = 0; (i + 1) < paths.size(); i++)
+	{
+		DiskItem* item = open(paths[i], operation);
+		if(item == NULL)
+			continue;
+		if(move)
+			item->cut();
+
+		Progress progress;
+		int64_t start = Stats::now();
+		if(! item->paste(to, &progress))
+			fail(operation, paths[i], errno);
+		else if(_json)
+		{
+			std::cout << "{\"op\":\"" << operation << "\",\"path\":" << quote(paths[i])
+				<< ",\"to\":" << quote(to + item->getName())
+				<< ",\"items\":" << progress.items << ",\"bytes\":" << progress.bytes
+				<< ",\"ms\":" << ((Stats::now() - start) / 1000000) << "}\n";
+		}
+		else
+			std::cout << paths[i] << " -> " << (to + item->getName()) << '\n';
+		std::cout.flush();
+		delete item;
+	}
+}
+
+//Deletes each item, walking trees across the workers:
+void Headless::remove(const std::vector <std::string>& paths)
+{
+	for(unsigned int i = 0; i < paths.size(); i++)
+	{
+		DiskItem* item = open(paths[i], "rm");
+		if(item == NULL)
+			continue;
+
+		Progress progress;
+		int64_t start = Stats::now();
+		if(! item->deletef(&progress))
+			fail("rm", paths[i], errno);
+		else if(_json)
+		{
+			std::cout << "{\"op\":\"rm\",\"path\":" << quote(paths[i]) << ",\"items\":" << progress.items
+				<< ",\"ms\":" << ((Stats::now() - start) / 1000000) << "}\n";
+		}
+		else
+			std::cout << "removed " << paths[i] << '\n';
+		std::cout.flush();
+		delete item;
+	}
+}
+
+//Opens a directory as a directory, and anything else as a file:
+DiskItem* Headless::open(const std::string& path, const char* operation)
+{
+	struct stat attr;
+	if(stat(path.c_str(), &attr) != 0)
+	{
+		//A broken link can still be deleted or moved:
+		if(lstat(path.c_str(), &attr) != 0)
+		{
+			fail(operation, path, errno);
+			return NULL;
+		}
+	}
+
+	if(S_ISDIR(attr.st_mode) != 0)
+		return new Directory(path, attr);
+	return new File(path, attr);
+}
+
+//Prints the error to stderr, and as JSON, to the output too:
+void Headless::fail(const char* operation, const std::string& path, int error)
+{
+	_failed = true;
+	std::cerr << "Cannot " << operation << " '" << path << "': " << strerror(error) << std::endl;
+	if(_json)
+	{
+		std::cout << "{\"op\":\"" << operation << "\",\"path\":" << quote(path)
+			<< ",\"error\":" << quote(strerror(error)) << "}\n";
+	}
+}
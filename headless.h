@@ -0,0 +1,63 @@
+// ---
+// headless.h
+//
+// Contains the class definition for the
+// headless front end, which drives the
+// same directories, files and workers as
+// the curses interface from the command
+// line, without a terminal: listing a
+// directory with its sizes, totalling
+// trees like 'du', and copying, moving and
+// deleting. Each result is printed as it
+// is ready, as a line of text, or as a
+// JSON object on its own line.
+// ---
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+#include "diskItem.h"
+#include <string>
+#include <vector>
+
+class Headless
+{
+	private:
+		//True if the results are printed as JSON:
+		bool _json;
+
+		//Set once anything has failed:
+		bool _failed;
+
+		//Lists the directory, with the size of each item:
+		void list(const std::string&);
+
+		//Prints the total size of each tree:
+		void total(const std::vector <std::string>&);
+
+		//Copies, or moves, the items into the last path, which must
+		//be a directory:
+		void copy(const std::vector <std::string>&, bool);
+
+		//Deletes each item:
+		void remove(const std::vector <std::string>&);
+
+		//Returns the item at the path, or NULL if it cannot be opened,
+		//after printing why:
+		DiskItem* open(const std::string&, const char*);
+
+		//Prints that the operation on the path failed, with the error:
+		void fail(const char*, const std::string&, int);
+
+	public:
+		//Default constructor, takes whether to print JSON:
+		Headless(bool);
+
+		//Returns true if the argument is one of the operations:
+		static bool isOperation(const std::string&);
+
+		//Runs the operation given on the paths, returning the exit
+		//status, which is 1 if anything failed:
+		int run(const std::string&, const std::vector <std::string>&);
+};
+
+#endif
@@ -0,0 +1,339 @@
+// --- jobs.cpp
+#include "jobs.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+
+Jobs::Jobs(Notifier* notifier)
+{
+	_transfers = 0;
+	_nextId = 0;
+	_idle = 0;
+	_stopping = false;
+	_notifier = notifier;
+}
+
+Jobs::~Jobs()
+{
+	//Only waits for the jobs running now. Transfers still waiting their
+	//turn are never started, and anything queued or paused is cancelled,
+	//so the user is not kept waiting on what they held back:
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_stopping = true;
+		for(unsigned int i = 0; i < _waiting.size(); i++)
+		{
+			_waiting[i]->result = ECANCELED;
+			_finished.push_back(_waiting[i]);
+			_running.erase(std::find(_running.begin(), _running.end(), _waiting[i]));
+		}
+		_waiting.clear();
+
+		for(unsigned int i = 0; i < _running.size(); i++)
+			if((! _running[i]->started) || (_running[i]->progress.isPaused()))
+				_running[i]->progress.cancel();
+	}
+	_wake.notify_all();
+
+	//A worker may start another as it hands on a transfer, so each
+	//one is taken out under the lock before being joined:
+	for(unsigned int i = 0; true; i++)
+	{
+		std::thread worker;
+		{
+			std::lock_guard <std::mutex> guard(_lock);
+			if(i >= _workers.size())
+				break;
+			worker.swap(_workers[i]);
+		}
+		worker.join();
+	}
+
+	for(unsigned int i = 0; i < _finished.size(); i++)
+		delete _finished[i];
+}
+
+void Jobs::work()
+{
+	while(true)
+	{
+		Job* job;
+
+		//Waits for a job, or for the jobs to be stopped once the
+		//queue is empty:
+		{
+			std::unique_lock <std::mutex> guard(_lock);
+			_idle++;
+			while((! _stopping) && (_queue.empty()))
+				_wake.wait(guard);
+			_idle--;
+
+			if(_queue.empty())
+				return;
+
+			job = _queue.front();
+			_queue.pop_front();
+			job->started = true;
+			job->begun = std::chrono::steady_clock::now();
+			job->sampled = job->begun;
+		}
+
+		//A job cancelled before it started is not run at all:
+		if(job->progress.isCancelled())
+			job->result = ECANCELED;
+		else
+			job->result = job->work(job->progress);
+
+		//Hands the job back to be collected, and lets the next
+		//transfer start in its place:
+		std::lock_guard <std::mutex> guard(_lock);
+		for(unsigned int i = 0; i < _running.size(); i++)
+		{
+			if(_running[i] == job)
+			{
+				_running.erase(_running.begin() + i);
+				break;
+			}
+		}
+		if(job->transfer)
+		{
+			_transfers--;
+			promote(1);
+
+			State state = (job->result == 0) ? DONE : ((job->result == ECANCELED) ? CANCELLED : FAILED);
+			_history.push_front(getStatus(job, state));
+			if(_history.size() > HISTORY)
+				_history.pop_back();
+		}
+		_finished.push_back(job);
+		if(_notifier != NULL)
+			_notifier->notify();
+	}
+}
+
+//Moves transfers from waiting to the queue. The number of workers
+//about to look at the queue is passed, so no more are started than
+//are needed:
+void Jobs::promote(unsigned int looking)
+{
+	for(unsigned int i = 0; (i < _waiting.size()) && (_transfers < MAX_TRANSFERS);)
+	{
+		if(_waiting[i]->progress.isPaused())
+		{
+			i++;
+			continue;
+		}
+
+		_queue.push_back(_waiting[i]);
+		_waiting.erase(_waiting.begin() + i);
+		_transfers++;
+	}
+
+	//A long copy should not hold up reading a directory, so every
+	//job gets a worker of its own. Workers are kept once started,
+	//as are the buffers each keeps for reading:
+	for(unsigned int i = (_idle + looking); i < _queue.size(); i++)
+		_workers.push_back(std::thread(&Jobs::work, this));
+	if(_queue.size() > 0)
+		_wake.notify_all();
+}
+
+//Queues a job, and makes sure there is a worker free to run it:
+unsigned int Jobs::start(const std::string& name, std::function <int(Progress&)> work, std::function <void(int)> done,
+	bool transfer)
+{
+	Job* job = new Job;
+	job->name = name;
+	job->transfer = transfer;
+	job->started = false;
+	job->work = work;
+	job->done = done;
+	job->result = 0;
+	job->sampledItems = 0;
+	job->sampledBytes = 0;
+	job->itemRate = 0;
+	job->byteRate = 0;
+
+	std::lock_guard <std::mutex> guard(_lock);
+	job->id = _nextId++;
+	_running.push_back(job);
+	if(transfer)
+		_waiting.push_back(job);
+	else
+		_queue.push_back(job);
+	promote(0);
+
+	return job->id;
+}
+
+void Jobs::cancel(unsigned int id)
+{
+	std::lock_guard <std::mutex> guard(_lock);
+
+	//A transfer still waiting for its turn finishes now:
+	for(unsigned int i = 0; i < _waiting.size(); i++)
+	{
+		Job* job = _waiting[i];
+		if(job->id == id)
+		{
+			_waiting.erase(_waiting.begin() + i);
+			for(unsigned int j = 0; j < _running.size(); j++)
+			{
+				if(_running[j] == job)
+				{
+					_running.erase(_running.begin() + j);
+					break;
+				}
+			}
+
+			job->begun = std::chrono::steady_clock::now();
+			job->result = ECANCELED;
+			_history.push_front(getStatus(job, CANCELLED));
+			if(_history.size() > HISTORY)
+				_history.pop_back();
+			_finished.push_back(job);
+			if(_notifier != NULL)
+				_notifier->notify();
+			return;
+		}
+	}
+
+	//Otherwise it stops the next time it checks:
+	Job* job = findJob(id);
+	if(job != NULL)
+		job->progress.cancel();
+}
+
+void Jobs::pause(unsigned int id)
+{
+	std::lock_guard <std::mutex> guard(_lock);
+	Job* job = findJob(id);
+	if(job == NULL)
+		return;
+
+	//A transfer let go on may be able to start now:
+	job->progress.pause(! job->progress.isPaused());
+	promote(0);
+}
+
+//Runs what each finished job was to do next:
+bool Jobs::collect()
+{
+	std::vector <Job*> finished;
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		finished.swap(_finished);
+	}
+
+	//The lock is not held, so these can start more jobs:
+	for(unsigned int i = 0; i < finished.size(); i++)
+	{
+		finished[i]->done(finished[i]->result);
+		delete finished[i];
+	}
+
+	return (finished.size() > 0);
+}
+
+std::vector <Jobs::Status> Jobs::getRunning()
+{
+	std::lock_guard <std::mutex> guard(_lock);
+	std::vector <Status> running;
+	for(unsigned int i = 0; i < _running.size(); i++)
+	{
+		Job* job = _running[i];
+		State state = RUNNING;
+		if(job->progress.isPaused())
+			state = PAUSED;
+		else if(! job->started)
+			state = QUEUED;
+		running.push_back(getStatus(job, state));
+	}
+	return running;
+}
+
+std::vector <Jobs::Status> Jobs::getHistory()
+{
+	std::lock_guard <std::mutex> guard(_lock);
+	return std::vector <Status> (_history.begin(), _history.end());
+}
+
+bool Jobs::busy()
+{
+	std::lock_guard <std::mutex> guard(_lock);
+	return ((_queue.size() > 0) || (_running.size() > 0) || (_finished.size() > 0));
+}
+
+Jobs::Job* Jobs::findJob(unsigned int id)
+{
+	for(unsigned int i = 0; i < _running.size(); i++)
+		if(_running[i]->id == id)
+			return _running[i];
+	return NULL;
+}
+
+//The rates are averaged over a second or more, and smoothed with the
+//rates before, so they do not jump about with each chunk. A finished
+//job's rates are its averages over the whole time it ran:
+Jobs::Status Jobs::getStatus(Job* job, State state)
+{
+	Status status;
+	status.id = job->id;
+	status.name = job->name;
+	status.state = state;
+	status.items = job->progress.items;
+	status.totalItems = job->progress.totalItems;
+	status.bytes = job->progress.bytes;
+	status.totalBytes = job->progress.totalBytes;
+	status.remaining = -1;
+	status.error = 0;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if((state == DONE) || (state == FAILED) || (state == CANCELLED))
+	{
+		double elapsed = std::chrono::duration <double> (now - job->begun).count();
+		status.itemRate = (elapsed > 0) ? (status.items / elapsed) : 0;
+		status.byteRate = (elapsed > 0) ? (status.bytes / elapsed) : 0;
+		status.remaining = 0;
+		status.error = job->result;
+		return status;
+	}
+
+	//Nothing is done while paused, so what it does once it goes on
+	//is measured from then:
+	if(state == PAUSED)
+	{
+		job->sampled = now;
+		job->sampledItems = status.items;
+		job->sampledBytes = status.bytes;
+		status.itemRate = 0;
+		status.byteRate = 0;
+		return status;
+	}
+
+	if(job->started)
+	{
+		double elapsed = std::chrono::duration <double> (now - job->sampled).count();
+		if(elapsed >= 1)
+		{
+			double itemRate = (status.items - job->sampledItems) / elapsed;
+			double byteRate = (status.bytes - job->sampledBytes) / elapsed;
+			job->itemRate = (job->sampledItems == 0) ? itemRate : ((job->itemRate + itemRate) / 2);
+			job->byteRate = (job->sampledBytes == 0) ? byteRate : ((job->byteRate + byteRate) / 2);
+			job->sampled = now;
+			job->sampledItems = status.items;
+			job->sampledBytes = status.bytes;
+		}
+	}
+	status.itemRate = job->itemRate;
+	status.byteRate = job->byteRate;
+
+	//Works out the time left from the bytes if their total is known,
+	//or otherwise from the items:
+	if((status.totalBytes > status.bytes) && (status.byteRate > 0))
+		status.remaining = ceil((status.totalBytes - status.bytes) / status.byteRate);
+	else if((status.totalItems > status.items) && (status.itemRate > 0))
+		status.remaining = ceil((status.totalItems - status.items) / status.itemRate);
+
+	return status;
+}
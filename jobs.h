@@ -0,0 +1,172 @@
+// ---
+// jobs.h
+//
+// Contains the class definition for the
+// jobs, which run the long filesystem
+// operations, like reading, pasting and
+// deleting, on background threads so the
+// interface never waits on them. When a
+// job finishes, what it was started with
+// to do next is run back on the thread
+// which collects it. Transfers, which can
+// take a long time, are queued so only a
+// few run at once, and can be paused or
+// cancelled while they wait or run.
+// ---
+
+#ifndef JOBS_H
+#define JOBS_H
+#include "notifier.h"
+#include "progress.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Jobs
+{
+	public:
+		//What a job is doing:
+		enum State { QUEUED, RUNNING, PAUSED, DONE, FAILED, CANCELLED };
+
+		//What is shown of a job: its id and description, what it is
+		//doing, how many items and bytes it has done out of how many,
+		//where the totals are 0 if they are not known, how many of each
+		//it is doing a second, and how many seconds it has left, or -1
+		//if that is not known. Once it has finished, the error it
+		//failed with, if it did:
+		struct Status
+		{
+			unsigned int id;
+			std::string name;
+			State state;
+			unsigned long long items;
+			unsigned long long totalItems;
+			unsigned long long bytes;
+			unsigned long long totalBytes;
+			double itemRate;
+			double byteRate;
+			long long remaining;
+			int error;
+		};
+
+	private:
+		//An operation to run, its id and description, whether it is a
+		//transfer and has been started, how far it has got, what to do
+		//with its result once it is collected, and the result, 0 if it
+		//worked:
+		struct Job
+		{
+			unsigned int id;
+			std::string name;
+			bool transfer;
+			bool started;
+			std::function <int(Progress&)> work;
+			Progress progress;
+			std::function <void(int)> done;
+			int result;
+
+			//When it started, and when its rates were last worked out,
+			//with what it had done by then, and the rates:
+			std::chrono::steady_clock::time_point begun;
+			std::chrono::steady_clock::time_point sampled;
+			unsigned long long sampledItems;
+			unsigned long long sampledBytes;
+			double itemRate;
+			double byteRate;
+		};
+
+		//The transfers waiting for their turn, the jobs waiting for a
+		//worker, those waiting or running, and those which have finished
+		//but not been collected:
+		std::deque <Job*> _waiting;
+		std::deque <Job*> _queue;
+		std::vector <Job*> _running;
+		std::vector <Job*> _finished;
+
+		//The number of transfers given to the workers:
+		unsigned int _transfers;
+
+		//The last few jobs to finish, newest first:
+		std::deque <Status> _history;
+
+		//The id the next job is given:
+		unsigned int _nextId;
+
+		//The worker threads, and how many are waiting for a job:
+		std::vector <std::thread> _workers;
+		unsigned int _idle;
+
+		//Guards everything above, and wakes idle workers:
+		std::mutex _lock;
+		std::condition_variable _wake;
+		bool _stopping;
+
+		//Told whenever a job finishes, may be NULL:
+		Notifier* _notifier;
+
+		//The main loop for each of the worker threads:
+		void work();
+
+		//Hands waiting transfers to the workers while there is room,
+		//skipping those paused, and makes sure there are workers free
+		//to run them, given how many are about to look for a job:
+		void promote(unsigned int);
+
+		//Returns the running job with the given id, or NULL:
+		Job* findJob(unsigned int);
+
+		//Returns what is shown of a job, working out its rates again
+		//if it has been long enough since they last were:
+		Status getStatus(Job*, State);
+
+	public:
+		//The most transfers that run at once, the rest are queued:
+		static const unsigned int MAX_TRANSFERS = 2;
+
+		//The most finished jobs remembered:
+		static const unsigned int HISTORY = 16;
+
+		//Default constructor, optionally takes a notifier to tell
+		//when there are jobs to collect:
+		Jobs(Notifier* = NULL);
+
+		//Destructor, cancels any jobs not yet started or paused, and
+		//waits for those running to finish:
+		~Jobs();
+
+		//Runs the work given on a background thread, starting another
+		//worker if every one is busy, unless it is a transfer and too
+		//many already are running. The work is passed somewhere to count
+		//what it has done, and check if it should stop. Once it has
+		//finished, 'collect()' passes its result to the second function.
+		//Returns the job's id:
+		unsigned int start(const std::string&, std::function <int(Progress&)>, std::function <void(int)>, bool = false);
+
+		//Cancels the job with the given id. A job which has not started
+		//finishes straight away, with a result of ECANCELED:
+		void cancel(unsigned int);
+
+		//Pauses the job with the given id, or lets it go on if it is
+		//already paused:
+		void pause(unsigned int);
+
+		//Runs the second function of each finished job on the calling
+		//thread, returns true if there were any:
+		bool collect();
+
+		//Returns the jobs waiting or running:
+		std::vector <Status> getRunning();
+
+		//Returns the last few jobs to have finished, newest first:
+		std::vector <Status> getHistory();
+
+		//Returns true if there are jobs waiting, running or finished:
+		bool busy();
+};
+
+#endif
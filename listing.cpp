@@ -0,0 +1,716 @@
+// --- listing.cpp
+#include "listing.h"
+#include "diskItem.h"
+#include "stats.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <strings.h>
+
+//The fewest items sorted with a radix sort:
+static const unsigned int RADIX_THRESHOLD = 2048;
+
+bool Listing::_natural = true;
+
+Listing::Listing()
+{
+	_dotfiles = 0;
+	_marked = 0;
+	_version = 0;
+	_keysNatural = _natural;
+}
+
+//Empties the listing, keeping the memory for the next one:
+void Listing::clear()
+{
+	_names.clear();
+	_offsets.clear();
+	_keys.clear();
+	_keyOffsets.clear();
+	_prefixes.clear();
+	_sizes.clear();
+	_modes.clear();
+	_mtimes.clear();
+	_flags.clear();
+	_order.clear();
+	_dotfiles = 0;
+	_marked = 0;
+	_version++;
+	_keysNatural = _natural;
+}
+
+//Makes room for the given number of items and bytes of names, so
+//filling in a big listing does not keep moving it around:
+void Listing::reserve(unsigned int items, size_t names)
+{
+	_names.reserve(names);
+	_offsets.reserve(items);
+	_keys.reserve(names + (items * 2));
+	_keyOffsets.reserve(items);
+	_prefixes.reserve(items);
+	_sizes.reserve(items);
+	_modes.reserve(items);
+	_mtimes.reserve(items);
+	_flags.reserve(items);
+	_order.reserve(items);
+}
+
+//Adds an item to the table, without placing it in the order:
+unsigned int Listing::add(const char* name, uint64_t size, uint32_t mode, int64_t mtime, uint8_t flags)
+{
+	unsigned int id = _offsets.size();
+	_version++;
+
+	_offsets.push_back(_names.size());
+	_names.append(name);
+	_names.push_back('\0');
+
+	_sizes.push_back(size);
+	_modes.push_back(mode);
+	_mtimes.push_back(mtime);
+	_flags.push_back(flags);
+	addKey(id);
+
+	return id;
+}
+
+//Works out and stores the sort key of the item just added:
+void Listing::addKey(unsigned int id)
+{
+	_keyOffsets.push_back(_keys.size());
+	makeKey(&_names[_offsets[id]], ((_flags[id] & DIRECTORY) != 0), _keys);
+	_keys.push_back('\0');
+	_prefixes.push_back(getChunk(id, 0));
+}
+
+//Adds the sort key for a name to the end of the string passed:
+void Listing::makeKey(const char* name, bool directory, std::string& key)
+{
+	//Dotfiles come before everything else:
+	key.push_back((name[0] == '.') ? 1 : 2);
+
+	const char* p = name;
+	while(*p != '\0')
+	{
+		unsigned char c = *p;
+
+		//A number is written as a '0', so it sorts against other
+		//characters as a digit would, then the number of digits, then
+		//the digits without any leading zeros, so a longer number is
+		//always bigger. The length is never a '\0':
+		if((_natural) && (isdigit(c)))
+		{
+			while(*p == '0')
+				p++;
+			const char* start = p;
+			while(isdigit((unsigned char)*p))
+				p++;
+
+			size_t digits = (p - start);
+			key.push_back('0');
+			key.push_back((char)(std::min(digits, (size_t)254) + 1));
+			key.append(start, digits);
+			continue;
+		}
+
+		//Only ASCII is folded, anything else is left as it is:
+		if(c < 0x80)
+			c = tolower(c);
+		key.push_back(c);
+		p++;
+	}
+
+	if(directory)
+		key.push_back('/');
+}
+
+//Adds an item to the end of the order, directories are left to be
+//sized later, and files are sized straight away:
+unsigned int Listing::append(const char* name, const struct stat& attr)
+{
+	uint8_t flags = SIZED;
+	uint64_t size = attr.st_size;
+	if(S_ISDIR(attr.st_mode) != 0)
+	{
+		flags = DIRECTORY;
+		size = 0;
+	}
+
+	unsigned int id = add(name, size, attr.st_mode, attr.st_mtime, flags);
+	_order.push_back(id);
+	return id;
+}
+
+//Returns true if the first item goes before the second. Names that
+//only differ in case, or in leading zeros, are sorted as they are:
+bool Listing::before(unsigned int a, unsigned int b)
+{
+	if(_prefixes[a] != _prefixes[b])
+		return (_prefixes[a] < _prefixes[b]);
+
+	int order = strcmp(&_keys[_keyOffsets[a]], &_keys[_keyOffsets[b]]);
+	if(order == 0)
+		order = strcmp(&_names[_offsets[a]], &_names[_offsets[b]]);
+	return (order < 0);
+}
+
+//Sorts the order by the first twelve bytes of the keys, sixteen bits at
+//a time from the last, then sorts any items with the same twelve bytes
+//by the rest of their keys. The bytes are copied out next to the ids,
+//in the order the items were added, so each pass reads through memory
+//in order, and each key is only looked at once:
+void Listing::radixSort()
+{
+	struct Entry
+	{
+		uint64_t high;
+		uint32_t low;
+		uint32_t id;
+	};
+
+	std::vector <Entry> entries(_order.size());
+	std::vector <Entry> sorted(_order.size());
+	for(unsigned int i = 0; i < _order.size(); i++)
+	{
+		entries[i].high = _prefixes[_order[i]];
+		entries[i].low = 0;
+		if((entries[i].high & 0xFF) != 0)
+			entries[i].low = (getChunk(_order[i], 8) >> 32);
+		entries[i].id = _order[i];
+	}
+
+	//Only the bits which differ between keys need sorting on, and there
+	//are usually few, as the keys share the same few first characters:
+	uint64_t highSame = ~(uint64_t)0;
+	uint32_t lowSame = ~(uint32_t)0;
+	for(unsigned int i = 1; i < entries.size(); i++)
+	{
+		highSame &= ~(entries[i].high ^ entries[0].high);
+		lowSame &= ~(entries[i].low ^ entries[0].low);
+	}
+
+	//Sorts sixteen bits at a time:
+	std::vector <size_t> counts(65536);
+	for(unsigned int pass = 0; pass < 6; pass++)
+	{
+		bool high = (pass >= 2);
+		unsigned int shift = ((high ? (pass - 2) : pass) * 16);
+		if((((high ? highSame : lowSame) >> shift) & 0xFFFF) == 0xFFFF)
+			continue;
+
+		std::fill(counts.begin(), counts.end(), 0);
+		for(unsigned int i = 0; i < entries.size(); i++)
+			counts[((high ? entries[i].high : entries[i].low) >> shift) & 0xFFFF]++;
+
+		size_t start = 0;
+		for(unsigned int i = 0; i < 65536; i++)
+		{
+			size_t count = counts[i];
+			counts[i] = start;
+			start += count;
+		}
+
+		for(unsigned int i = 0; i < entries.size(); i++)
+			sorted[counts[((high ? entries[i].high : entries[i].low) >> shift) & 0xFFFF]++] = entries[i];
+		entries.swap(sorted);
+	}
+
+	for(unsigned int i = 0; i < entries.size(); i++)
+		_order[i] = entries[i].id;
+
+	//A key that ends within the twelve bytes is the same as the others
+	//in its run, so they are sorted by name, otherwise by the rest of it:
+	std::vector <std::pair <uint64_t, uint32_t> > chunks(entries.size());
+	for(unsigned int i = 0; i < entries.size();)
+	{
+		unsigned int same = i + 1;
+		while((same < entries.size()) && (entries[same].high == entries[i].high) && (entries[same].low == entries[i].low))
+			same++;
+
+		if((same - i) > 1)
+		{
+			if(((entries[i].high & 0xFF) == 0) || ((entries[i].low & 0xFF) == 0))
+				std::sort((_order.begin() + i), (_order.begin() + same),
+					[this](uint32_t a, uint32_t b) { return before(a, b); });
+			else
+				sortRun(i, same, 12, chunks);
+		}
+		i = same;
+	}
+}
+
+//Sorts the items at the given places in the order, whose keys all start
+//with the same given number of bytes, by the next eight bytes of their
+//keys. These are copied out next to the ids, into the same places in the
+//vector passed, so each key is only looked at once, rather than every
+//time it is compared:
+void Listing::sortRun(unsigned int start, unsigned int end, unsigned int depth, std::vector <std::pair <uint64_t, uint32_t> >& chunks)
+{
+	for(unsigned int i = start; i < end; i++)
+		chunks[i] = std::make_pair(getChunk(_order[i], depth), _order[i]);
+
+	std::sort((chunks.begin() + start), (chunks.begin() + end));
+	for(unsigned int i = start; i < end; i++)
+		_order[i] = chunks[i].second;
+
+	//A chunk ending in a '\0' is the end of the key, so those items have
+	//the same keys, and are sorted by their names, otherwise they are
+	//sorted by the next chunk. That only overwrites the chunks of items
+	//already passed here:
+	for(unsigned int i = start; i < end;)
+	{
+		unsigned int same = i + 1;
+		while((same < end) && (chunks[same].first == chunks[i].first))
+			same++;
+
+		if((same - i) > 1)
+		{
+			if((chunks[i].first & 0xFF) == 0)
+				std::sort((_order.begin() + i), (_order.begin() + same),
+					[this](uint32_t a, uint32_t b) { return before(a, b); });
+			else
+				sortRun(i, same, (depth + 8), chunks);
+		}
+		i = same;
+	}
+}
+
+//Returns eight bytes of the item's key from the given place, as a number:
+uint64_t Listing::getChunk(unsigned int id, unsigned int depth)
+{
+	//Keys never contain a '\0', so a short key is padded with zeros
+	//and still sorts before any longer key it starts:
+	const unsigned char* key = (const unsigned char*)&_keys[_keyOffsets[id] + depth];
+	uint64_t chunk = 0;
+	for(unsigned int i = 0; i < 8; i++)
+	{
+		chunk <<= 8;
+		if(*key != '\0')
+			chunk |= *key++;
+	}
+	return chunk;
+}
+
+//Sorts every item, counting the dotfiles:
+void Listing::sort()
+{
+	Stats::Span span(Stats::SORT);
+	_version++;
+
+	//Counted first, while the items are still in the order they
+	//were added, which is the order their names are kept in:
+	_dotfiles = 0;
+	for(unsigned int i = 0; i < _order.size(); i++)
+		if(_names[_offsets[_order[i]]] == '.')
+			_dotfiles++;
+
+	if(_order.size() >= RADIX_THRESHOLD)
+		radixSort();
+	else
+		std::sort(_order.begin(), _order.end(),
+			[this](uint32_t a, uint32_t b) { return before(a, b); });
+}
+
+//Works out the sort keys again, and sorts every item:
+void Listing::resort()
+{
+	_keys.clear();
+	_keyOffsets.clear();
+	_prefixes.clear();
+	_keysNatural = _natural;
+	for(unsigned int i = 0; i < _offsets.size(); i++)
+		addKey(i);
+
+	//The link to the parent is taken out, and put back after sorting:
+	std::vector <uint32_t>::iterator parent = std::find_if(_order.begin(), _order.end(),
+		[this](uint32_t id) { return isParent(id); });
+	bool hasParent = (parent != _order.end());
+	unsigned int id = 0;
+	if(hasParent)
+	{
+		id = *parent;
+		_order.erase(parent);
+	}
+
+	sort();
+
+	if(hasParent)
+		_order.insert(_order.begin() + _dotfiles, id);
+}
+
+//Adds the link to the parent directory, so it is at the top of
+//the items, but after any dotfiles:
+void Listing::addParent()
+{
+	unsigned int id = add("..", 0, S_IFDIR, 0, (DIRECTORY | PARENT));
+	_order.insert(_order.begin() + _dotfiles, id);
+}
+
+//Merges a run into the listing. The run's table is added to the end of
+//this one, then the two orders are merged, the dotfiles first, then the
+//rest, keeping the link to the parent between them:
+void Listing::merge(Listing& run)
+{
+	_version++;
+
+	//The first run is taken as it is:
+	if(_offsets.empty())
+	{
+		_names.swap(run._names);
+		_offsets.swap(run._offsets);
+		_keys.swap(run._keys);
+		_keyOffsets.swap(run._keyOffsets);
+		_prefixes.swap(run._prefixes);
+		_sizes.swap(run._sizes);
+		_modes.swap(run._modes);
+		_mtimes.swap(run._mtimes);
+		_flags.swap(run._flags);
+		_order.swap(run._order);
+		std::swap(_dotfiles, run._dotfiles);
+		std::swap(_marked, run._marked);
+		_keysNatural = run._keysNatural;
+		run.clear();
+		return;
+	}
+
+	uint32_t base = _offsets.size();
+	uint32_t names = _names.size();
+	uint32_t keys = _keys.size();
+
+	_names.append(run._names);
+	_keys.append(run._keys);
+	for(unsigned int i = 0; i < run._offsets.size(); i++)
+	{
+		_offsets.push_back(run._offsets[i] + names);
+		_keyOffsets.push_back(run._keyOffsets[i] + keys);
+	}
+	_prefixes.insert(_prefixes.end(), run._prefixes.begin(), run._prefixes.end());
+	_sizes.insert(_sizes.end(), run._sizes.begin(), run._sizes.end());
+	_modes.insert(_modes.end(), run._modes.begin(), run._modes.end());
+	_mtimes.insert(_mtimes.end(), run._mtimes.begin(), run._mtimes.end());
+	_flags.insert(_flags.end(), run._flags.begin(), run._flags.end());
+
+	std::vector <uint32_t> added(run._order.size());
+	for(unsigned int i = 0; i < run._order.size(); i++)
+		added[i] = run._order[i] + base;
+
+	std::vector <uint32_t> order;
+	order.reserve(_order.size() + added.size());
+	std::vector <uint32_t>::iterator rest = _order.begin() + _dotfiles;
+	std::merge(_order.begin(), rest, added.begin(), (added.begin() + run._dotfiles), std::back_inserter(order),
+		[this](uint32_t a, uint32_t b) { return before(a, b); });
+	if((rest != _order.end()) && (isParent(*rest)))
+		order.push_back(*rest++);
+	std::merge(rest, _order.end(), (added.begin() + run._dotfiles), added.end(), std::back_inserter(order),
+		[this](uint32_t a, uint32_t b) { return before(a, b); });
+
+	_order.swap(order);
+	_dotfiles += run._dotfiles;
+	_marked += run._marked;
+	run.clear();
+}
+
+//Adds an item among the dotfiles if it is one, or after the link to
+//the parent otherwise, keeping the order sorted:
+unsigned int Listing::insert(const char* name, const struct stat& attr)
+{
+	unsigned int id = append(name, attr);
+	_order.pop_back();
+
+	std::vector <uint32_t>::iterator start = _order.begin();
+	std::vector <uint32_t>::iterator end = _order.begin() + _dotfiles;
+
+	if(name[0] == '.')
+		_dotfiles++;
+	else
+	{
+		start = end;
+		end = _order.end();
+		if((start != end) && (isParent(*start)))
+			start++;
+	}
+
+	_order.insert(std::upper_bound(start, end, id,
+		[this](uint32_t a, uint32_t b) { return before(a, b); }), id);
+	return id;
+}
+
+//Removes the item at the given place in the order:
+unsigned int Listing::remove(unsigned int index)
+{
+	unsigned int id = _order[index];
+	_order.erase(_order.begin() + index);
+	_version++;
+
+	if(index < _dotfiles)
+		_dotfiles--;
+	if(isMarked(id))
+	{
+		_flags[id] &= ~MARKED;
+		_marked--;
+	}
+
+	return id;
+}
+
+//Returns the place in the order of the item with the given name:
+unsigned int Listing::find(const std::string& name)
+{
+	//Directories are shown with a '/', but stored without one:
+	size_t length = name.size();
+	if((length > 0) && (name[length - 1] == '/'))
+		length--;
+
+	for(unsigned int i = 0; i < _order.size(); i++)
+	{
+		const char* other = &_names[_offsets[_order[i]]];
+		if((strncmp(other, name.c_str(), length) == 0) && (other[length] == '\0') && (! isParent(_order[i])))
+			return i;
+	}
+	return _order.size();
+}
+
+//Keys never contain a '\0', so one that another starts with sorts first:
+bool Listing::isBefore(unsigned int id, const std::string& key)
+{
+	return (strcmp(&_keys[_keyOffsets[id]], key.c_str()) < 0);
+}
+
+//Finds each place the text's first character is in the whole pool with
+//'memchr', which looks at many bytes at once, looking for both cases of
+//it if case is ignored, and only compares the rest where it is found.
+//A match cannot run on into the next name, as the text has no '\0' in
+//it. Once a name matches, the search goes on from the next. The places
+//found only ever go forwards, so the name each is in is found by moving
+//on through the names from the last:
+void Listing::search(const std::string& text, bool fold, std::vector <uint8_t>& found)
+{
+	found.assign(_offsets.size(), 0);
+	if(text.empty())
+		return;
+
+	const char* start = _names.data();
+	const char* end = start + _names.size();
+	size_t length = text.size();
+
+	unsigned char lower = text[0];
+	unsigned char upper = lower;
+	if((fold) && (lower < 0x80))
+	{
+		lower = tolower(lower);
+		upper = toupper(lower);
+	}
+
+	const uint32_t* offsets = _offsets.data();
+	unsigned int count = _offsets.size();
+	unsigned int id = 0;
+
+	const char* nextLower = (const char*)memchr(start, lower, (end - start));
+	const char* nextUpper = (upper != lower) ? (const char*)memchr(start, upper, (end - start)) : NULL;
+	while((nextLower != NULL) || (nextUpper != NULL))
+	{
+		const char* hit = nextLower;
+		if((hit == NULL) || ((nextUpper != NULL) && (nextUpper < hit)))
+			hit = nextUpper;
+
+		const char* from = hit + 1;
+		if((length == 1) || (((fold) ? strncasecmp(hit, text.c_str(), length) : strncmp(hit, text.c_str(), length)) == 0))
+		{
+			uint32_t place = (hit - start);
+			while(((id + 1) < count) && (offsets[id + 1] <= place))
+				id++;
+			found[id] = 1;
+			from = start + (((id + 1) < count) ? offsets[id + 1] : _names.size());
+		}
+
+		if((nextLower != NULL) && (nextLower < from))
+			nextLower = (const char*)memchr(from, lower, (end - from));
+		if((nextUpper != NULL) && (nextUpper < from))
+			nextUpper = (const char*)memchr(from, upper, (end - from));
+	}
+}
+
+//Returns the place in the order of the item with the given id:
+unsigned int Listing::indexOf(unsigned int id, unsigned int hint)
+{
+	//Unless the listing has changed, it will be where it was:
+	if((hint < _order.size()) && (_order[hint] == id))
+		return hint;
+
+	return (std::find(_order.begin(), _order.end(), id) - _order.begin());
+}
+
+//Sets the size once it has been calculated:
+void Listing::setSize(unsigned int id, unsigned long long size)
+{
+	_sizes[id] = size;
+	_flags[id] |= SIZED;
+	_flags[id] &= ~UNREADABLE;
+}
+
+//Counts a directory which could not be read as sized, with nothing in it:
+void Listing::setUnreadable(unsigned int id)
+{
+	_sizes[id] = 0;
+	_flags[id] |= (SIZED | UNREADABLE);
+}
+
+//Marks or unmarks an item, keeping count of those marked:
+void Listing::setMarked(unsigned int id, bool marked)
+{
+	if(marked == isMarked(id))
+		return;
+
+	if(marked)
+	{
+		_flags[id] |= MARKED;
+		_marked++;
+	}
+	else
+	{
+		_flags[id] &= ~MARKED;
+		_marked--;
+	}
+}
+
+//Returns the number of items marked:
+unsigned int Listing::getMarked()
+{
+	return _marked;
+}
+
+//Sets whether numbers in names are sorted by their value:
+void Listing::setNatural(bool natural)
+{
+	_natural = natural;
+}
+
+//Returns true if numbers in names are sorted by their value:
+bool Listing::isNatural()
+{
+	return _natural;
+}
+
+bool Listing::isSortedNaturally()
+{
+	return _keysNatural;
+}
+
+//Returns the number of items in the order:
+unsigned int Listing::size()
+{
+	return _order.size();
+}
+
+//Returns the number of ids given out:
+unsigned int Listing::getIds()
+{
+	return _offsets.size();
+}
+
+//Returns the id of the item at the given place in the order:
+unsigned int Listing::getId(unsigned int index)
+{
+	return _order[index];
+}
+
+//Returns the number of dotfiles:
+unsigned int Listing::getDotfiles()
+{
+	return _dotfiles;
+}
+
+//Returns the count of changes to the items or their order:
+unsigned int Listing::getVersion()
+{
+	return _version;
+}
+
+//Returns the approximate number of bytes the listing uses:
+size_t Listing::getFootprint()
+{
+	return sizeof(*this) + _names.capacity() + _keys.capacity()
+		+ (_offsets.capacity() * sizeof(uint32_t))
+		+ (_keyOffsets.capacity() * sizeof(uint32_t))
+		+ (_prefixes.capacity() * sizeof(uint64_t))
+		+ (_sizes.capacity() * sizeof(uint64_t))
+		+ (_modes.capacity() * sizeof(uint32_t))
+		+ (_mtimes.capacity() * sizeof(int64_t))
+		+ (_flags.capacity() * sizeof(uint8_t))
+		+ (_order.capacity() * sizeof(uint32_t));
+}
+
+//Returns the name, with a '/' on the end if it is a directory:
+std::string Listing::getName(unsigned int id)
+{
+	std::string name = &_names[_offsets[id]];
+	if(_flags[id] & DIRECTORY)
+		name += '/';
+	return name;
+}
+
+//Returns the name as it is stored, without a '/':
+const char* Listing::getRawName(unsigned int id)
+{
+	return &_names[_offsets[id]];
+}
+
+//Returns the size:
+unsigned long long Listing::getSize(unsigned int id)
+{
+	return _sizes[id];
+}
+
+//Returns the size with an appropriate unit, or a placeholder if it is
+//still being calculated or could not be:
+std::string Listing::getFormattedSize(unsigned int id)
+{
+	if(! isSized(id))
+		return "calculating...";
+	if(isUnreadable(id))
+		return "unreadable";
+	return formatSize(_sizes[id]);
+}
+
+//Returns the mode:
+mode_t Listing::getMode(unsigned int id)
+{
+	return _modes[id];
+}
+
+//Returns the time the item was last modified:
+time_t Listing::getMtime(unsigned int id)
+{
+	return _mtimes[id];
+}
+
+//Returns true if the size has been calculated:
+bool Listing::isSized(unsigned int id)
+{
+	return ((_flags[id] & SIZED) != 0);
+}
+
+//Returns true if the item is a directory:
+bool Listing::isDirectory(unsigned int id)
+{
+	return ((_flags[id] & DIRECTORY) != 0);
+}
+
+//Returns true if the item is the link to the parent directory:
+bool Listing::isParent(unsigned int id)
+{
+	return ((_flags[id] & PARENT) != 0);
+}
+
+//Returns true if the item has been marked:
+bool Listing::isMarked(unsigned int id)
+{
+	return ((_flags[id] & MARKED) != 0);
+}
+
+//Returns true if the item could not be sized:
+bool Listing::isUnreadable(unsigned int id)
+{
+	return ((_flags[id] & UNREADABLE) != 0);
+}
@@ -0,0 +1,208 @@
+// ---
+// listing.h
+//
+// Contains the class definition for a
+// listing, the compact table of the items
+// in a directory. Rather than an object
+// for each item, the names are kept
+// together in one pool, and the sizes,
+// modes, times and flags in arrays next
+// to it, each indexed by the item's id.
+// Ids never change once given out, so the
+// order the items are shown in is kept as
+// a separate array of ids. Each item also
+// has a sort key, worked out once when it
+// is added, so sorting only compares bytes.
+// A listing can also be built up from runs,
+// each sorted separately, then merged in.
+// ---
+
+#ifndef LISTING_H
+#define LISTING_H
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/stat.h>
+
+class Listing
+{
+	private:
+		//The names, each followed by a '\0', without the '/'
+		//directories are shown with, and where each starts:
+		std::string _names;
+		std::vector <uint32_t> _offsets;
+
+		//The sort keys, each followed by a '\0', where each starts,
+		//and the first eight bytes of each as a number, so most
+		//comparisons do not have to look at the keys at all:
+		std::string _keys;
+		std::vector <uint32_t> _keyOffsets;
+		std::vector <uint64_t> _prefixes;
+
+		//The attributes of each item:
+		std::vector <uint64_t> _sizes;
+		std::vector <uint32_t> _modes;
+		std::vector <int64_t> _mtimes;
+		std::vector <uint8_t> _flags;
+
+		//The ids of the items still in the listing, in the order they
+		//are shown, with the dotfiles first, then the parent link:
+		std::vector <uint32_t> _order;
+
+		//The number of dotfiles at the front of the order:
+		unsigned int _dotfiles;
+
+		//The number of items marked:
+		unsigned int _marked;
+
+		//Counts every change to the items or their order:
+		unsigned int _version;
+
+		//True if numbers in names are sorted by their value, and
+		//whether they were when this listing's keys were worked out:
+		static bool _natural;
+		bool _keysNatural;
+
+		//Works out and stores the sort key of the item just added:
+		void addKey(unsigned int);
+
+		//Sorts the order by the keys' prefixes a byte at a time,
+		//used for big listings:
+		void radixSort();
+
+		//Sorts part of the order by the next part of the keys:
+		void sortRun(unsigned int, unsigned int, unsigned int, std::vector <std::pair <uint64_t, uint32_t> >&);
+
+		//Returns eight bytes of an item's key, from the given place:
+		uint64_t getChunk(unsigned int, unsigned int);
+
+		//Adds an item to the table, without placing it in the order:
+		unsigned int add(const char*, uint64_t, uint32_t, int64_t, uint8_t);
+
+		//Returns true if the first item goes before the second:
+		bool before(unsigned int, unsigned int);
+
+	public:
+		//The flags each item can have:
+		static const uint8_t DIRECTORY = 1;
+		static const uint8_t SIZED = 2;
+		static const uint8_t PARENT = 4;
+		static const uint8_t MARKED = 8;
+		static const uint8_t UNREADABLE = 16;
+
+		//Default constructor, creates an empty listing:
+		Listing();
+
+		//Empties the listing:
+		void clear();
+
+		//Makes room for the given number of items and bytes of names:
+		void reserve(unsigned int, size_t);
+
+		//Adds an item with the given name and attributes to the end of
+		//the order, returning its id. Once every item has been added,
+		//'sort()' puts them in order:
+		unsigned int append(const char*, const struct stat&);
+
+		//Sorts every item, counting the dotfiles:
+		void sort();
+
+		//Works out the sort keys again, and sorts every item, after
+		//the way numbers are sorted has changed:
+		void resort();
+
+		//Adds the link to the parent directory, after the dotfiles:
+		void addParent();
+
+		//Adds every item in the sorted listing passed, which is left
+		//empty, merging them into the order. Their ids are given out
+		//after those already given, in the same order they had:
+		void merge(Listing&);
+
+		//Adds an item, keeping the order sorted, and returns its id:
+		unsigned int insert(const char*, const struct stat&);
+
+		//Removes the item at the given place in the order, returning
+		//its id. Its entry in the table stays until the next 'clear()':
+		unsigned int remove(unsigned int);
+
+		//Returns the place in the order of the item with the given name,
+		//with or without a trailing '/', or 'size()' if there is not one:
+		unsigned int find(const std::string&);
+
+		//Returns the place in the order of the item with the given id,
+		//or 'size()' if it has been removed. The place it was last seen
+		//can be passed, and is checked first:
+		unsigned int indexOf(unsigned int, unsigned int = 0);
+
+		//Sets the flag, in the vector given, of each item whose name
+		//contains the text given, ignoring the case of ASCII letters if
+		//asked to. The vector is indexed by id, and includes removed
+		//items. The names are searched together, as one block:
+		void search(const std::string&, bool, std::vector <uint8_t>&);
+
+		//Returns true if the item with the given id sorts before the key
+		//given, made by 'makeKey()':
+		bool isBefore(unsigned int, const std::string&);
+
+		//Sets the size once it has been calculated:
+		void setSize(unsigned int, unsigned long long);
+
+		//Gives up on sizing a directory which could not be read:
+		void setUnreadable(unsigned int);
+
+		//Marks or unmarks the item with the given id:
+		void setMarked(unsigned int, bool);
+
+		//Returns the number of items marked:
+		unsigned int getMarked();
+
+		//Returns the number of items in the order:
+		unsigned int size();
+
+		//Returns the number of ids given out, including those of items
+		//since removed:
+		unsigned int getIds();
+
+		//Returns the id of the item at the given place in the order:
+		unsigned int getId(unsigned int);
+
+		//Returns the number of dotfiles:
+		unsigned int getDotfiles();
+
+		//Returns a number which changes whenever an item is added or
+		//removed, or the items are sorted again:
+		unsigned int getVersion();
+
+		//Returns the approximate number of bytes the listing uses:
+		size_t getFootprint();
+
+		//Sets whether numbers in names are sorted by their value, so
+		//'file2' comes before 'file10', for listings sorted after:
+		static void setNatural(bool);
+		static bool isNatural();
+
+		//Returns true if the listing was sorted with numbers sorted by
+		//their value, which may no longer be the setting:
+		bool isSortedNaturally();
+
+		//Adds the sort key for a name to the end of the string passed.
+		//Keys put dotfiles first, ignore case, and sort numbers by value
+		//if set to. Directories are sorted as if their name ended in '/':
+		static void makeKey(const char*, bool, std::string&);
+
+		//Getters, each taking an item's id. Directory names end in '/':
+		std::string getName(unsigned int);
+		const char* getRawName(unsigned int);
+		unsigned long long getSize(unsigned int);
+		std::string getFormattedSize(unsigned int);
+		mode_t getMode(unsigned int);
+		time_t getMtime(unsigned int);
+		bool isSized(unsigned int);
+		bool isDirectory(unsigned int);
+		bool isParent(unsigned int);
+		bool isMarked(unsigned int);
+		bool isUnreadable(unsigned int);
+};
+
+#endif
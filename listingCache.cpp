@@ -0,0 +1,136 @@
+// --- listingCache.cpp
+#include "listingCache.h"
+
+ListingCache::ListingCache(size_t budget)
+{
+	_budget = budget;
+	_used = 0;
+}
+
+ListingCache::~ListingCache()
+{
+	trim(0);
+}
+
+//Keeps the directory at the front, with the modification time it had
+//when it was opened, before it was read. Any change made since, even
+//one the watcher has already put in its listing, makes it be read again
+//rather than risk keeping one the listing missed:
+void ListingCache::put(Directory* dir, unsigned int selected, unsigned int top)
+{
+	const struct stat& attr = dir->getAttributes();
+	Entry entry;
+	entry.dir = dir;
+	entry.dev = attr.st_dev;
+	entry.ino = attr.st_ino;
+	entry.mtime = attr.st_mtim;
+	entry.selected = selected;
+	entry.top = top;
+	entry.footprint = dir->getListing().getFootprint() + dir->getPath().capacity();
+
+	//Anything kept for the same directory is older, so is replaced:
+	for(std::list <Entry>::iterator i = _entries.begin(); i != _entries.end(); i++)
+	{
+		if((i->dev == entry.dev) && (i->ino == entry.ino))
+		{
+			_used -= i->footprint;
+			delete i->dir;
+			_entries.erase(i);
+			break;
+		}
+	}
+
+	if(entry.footprint > _budget)
+	{
+		delete dir;
+		return;
+	}
+
+	trim(_budget - entry.footprint);
+	_entries.push_front(entry);
+	_used += entry.footprint;
+}
+
+//Finds the directory by its device and inode. The path has to match as
+//well, as a directory reached through a link is shown with the path it
+//was reached by:
+Directory* ListingCache::take(Directory* dir, unsigned int& selected, unsigned int& top)
+{
+	const struct stat& attr = dir->getAttributes();
+	for(std::list <Entry>::iterator i = _entries.begin(); i != _entries.end(); i++)
+	{
+		if((i->dev != attr.st_dev) || (i->ino != attr.st_ino))
+			continue;
+
+		Directory* kept = i->dir;
+		bool unchanged = ((i->mtime.tv_sec == attr.st_mtim.tv_sec) &&
+			(i->mtime.tv_nsec == attr.st_mtim.tv_nsec) && (kept->getPath() == dir->getPath()));
+		if(unchanged)
+		{
+			selected = i->selected;
+			top = i->top;
+
+			//Numbers may have been sorted differently since it was left:
+			Listing& listing = kept->getListing();
+			if(listing.isSortedNaturally() != Listing::isNatural())
+				listing.resort();
+		}
+		else
+		{
+			delete kept;
+			kept = NULL;
+		}
+		_used -= i->footprint;
+		_entries.erase(i);
+		return kept;
+	}
+	return NULL;
+}
+
+bool ListingCache::has(const std::string& path)
+{
+	struct stat attr;
+	if(stat(path.c_str(), &attr) != 0)
+		return false;
+
+	for(std::list <Entry>::iterator i = _entries.begin(); i != _entries.end(); i++)
+	{
+		if((i->dev == attr.st_dev) && (i->ino == attr.st_ino))
+			return ((i->mtime.tv_sec == attr.st_mtim.tv_sec) && (i->mtime.tv_nsec == attr.st_mtim.tv_nsec));
+	}
+	return false;
+}
+
+void ListingCache::setBudget(size_t budget)
+{
+	_budget = budget;
+	trim(_budget);
+}
+
+//Deletes from the back, where the least recently left directories are:
+void ListingCache::trim(size_t budget)
+{
+	while((_used > budget) && (! _entries.empty()))
+	{
+		_used -= _entries.back().footprint;
+		delete _entries.back().dir;
+		_entries.pop_back();
+	}
+	if(_entries.empty())
+		_used = 0;
+}
+
+size_t ListingCache::getBudget()
+{
+	return _budget;
+}
+
+size_t ListingCache::getUsed()
+{
+	return _used;
+}
+
+unsigned int ListingCache::size()
+{
+	return _entries.size();
+}
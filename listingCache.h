@@ -0,0 +1,91 @@
+// ---
+// listingCache.h
+//
+// Contains the class definition for the
+// listing cache, which keeps the directories
+// most recently left, read and sorted, so
+// going back to one shows it straight away,
+// with the same item selected and the same
+// rows on screen, rather than reading it
+// again.
+//
+// Directories are found by their device and
+// inode, and only reused if they still have
+// the modification time they had when they
+// were opened, which changes whenever
+// anything is added to, removed from or
+// renamed in them. The least recently used are thrown
+// away once the listings take up more memory
+// than the cache is allowed.
+// ---
+
+#ifndef LISTING_CACHE_H
+#define LISTING_CACHE_H
+#include "directory.h"
+#include <list>
+#include <string>
+#include <sys/stat.h>
+
+class ListingCache
+{
+	private:
+		//A directory left, the id of the item that was selected in
+		//it, the first row shown, and the memory its listing uses:
+		struct Entry
+		{
+			Directory* dir;
+			dev_t dev;
+			ino_t ino;
+			struct timespec mtime;
+			unsigned int selected;
+			unsigned int top;
+			size_t footprint;
+		};
+
+		//The directories, from most to least recently left:
+		std::list <Entry> _entries;
+
+		//The most memory the listings may use, and how much they do:
+		size_t _budget;
+		size_t _used;
+
+		//Throws away the least recently left directories until the
+		//listings fit in the memory given:
+		void trim(size_t);
+
+	public:
+		//The memory the listings may use, unless set:
+		static const size_t DEFAULT_BUDGET = (64 << 20);
+
+		//Default constructor, takes the memory the listings may use:
+		ListingCache(size_t = DEFAULT_BUDGET);
+
+		//Destructor, deletes every directory kept:
+		~ListingCache();
+
+		//Keeps the directory, which must have been read in full, with
+		//the id of the item selected and the first row shown. The cache
+		//takes it over, and deletes it if it is too big to keep:
+		void put(Directory*, unsigned int, unsigned int);
+
+		//Takes back the directory with the same path and attributes as
+		//the one given, setting the item that was selected in it and the
+		//first row shown. Returns NULL if it is not kept, or has changed
+		//since it was left, in which case it is thrown away:
+		Directory* take(Directory*, unsigned int&, unsigned int&);
+
+		//Returns true if the directory at the path given is kept, and
+		//has not changed since:
+		bool has(const std::string&);
+
+		//Sets the memory the listings may use, throwing away what no
+		//longer fits. 0 keeps nothing:
+		void setBudget(size_t);
+
+		//Getters:
+		size_t getBudget();
+		size_t getUsed();
+		unsigned int size();
+};
+
+#endif
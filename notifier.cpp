@@ -0,0 +1,39 @@
+// --- notifier.cpp
+#include "notifier.h"
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+Notifier::Notifier()
+{
+	_fd = eventfd(0, (EFD_NONBLOCK | EFD_CLOEXEC));
+}
+
+Notifier::~Notifier()
+{
+	if(_fd >= 0)
+		close(_fd);
+}
+
+//Adds to the eventfd's count, making it readable:
+void Notifier::notify()
+{
+	uint64_t one = 1;
+	if(_fd >= 0)
+		if(write(_fd, &one, sizeof(one)) < 0)
+			return;
+}
+
+//Reads the count back to zero:
+void Notifier::clear()
+{
+	uint64_t count;
+	if(_fd >= 0)
+		if(read(_fd, &count, sizeof(count)) < 0)
+			return;
+}
+
+int Notifier::getFd()
+{
+	return _fd;
+}
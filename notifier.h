@@ -0,0 +1,38 @@
+// ---
+// notifier.h
+//
+// Contains the class definition for the
+// notifier, an eventfd the background
+// threads write to when they have work
+// waiting to be collected, so the main
+// loop can sleep until there is some.
+// ---
+
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+class Notifier
+{
+	private:
+		//The eventfd, -1 if it could not be created:
+		int _fd;
+
+	public:
+		//Default constructor:
+		Notifier();
+
+		//Destructor:
+		~Notifier();
+
+		//Wakes whoever is waiting on the notifier, safe to call
+		//from any thread:
+		void notify();
+
+		//Clears any waiting notifications:
+		void clear();
+
+		//Returns the eventfd, or -1 if there is none:
+		int getFd();
+};
+
+#endif
@@ -0,0 +1,146 @@
+// --- prefetcher.cpp
+#include "prefetcher.h"
+#include <cerrno>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+const std::chrono::milliseconds Prefetcher::DELAY(250);
+
+//The arguments to put the calling thread's disk reads in the idle class,
+//which only gets the disk when nothing else wants it:
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_IDLE = (3 << 13);
+
+Prefetcher::Prefetcher(Notifier* notifier, unsigned int maxItems)
+{
+	_generation = 0;
+	_progress = NULL;
+	_maxItems = maxItems;
+	_stopping = false;
+	_notifier = notifier;
+	_worker = std::thread(&Prefetcher::work, this);
+}
+
+Prefetcher::~Prefetcher()
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_stopping = true;
+		if(_progress != NULL)
+			_progress->cancel();
+	}
+	_wake.notify_all();
+	_worker.join();
+
+	for(unsigned int i = 0; i < _done.size(); i++)
+		delete _done[i];
+}
+
+void Prefetcher::request(const std::vector <std::string>& paths)
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_paths = paths;
+		_generation++;
+		if(_progress != NULL)
+			_progress->cancel();
+	}
+	_wake.notify_all();
+}
+
+void Prefetcher::cancel()
+{
+	request(std::vector <std::string>());
+}
+
+//Hands over the directories read:
+bool Prefetcher::collect(std::vector <Directory*>& dirs)
+{
+	std::lock_guard <std::mutex> guard(_lock);
+
+	dirs.insert(dirs.end(), _done.begin(), _done.end());
+	bool read = (_done.size() > 0);
+	_done.clear();
+	return read;
+}
+
+void Prefetcher::work()
+{
+	//Reads at the lowest priority, for both the processor and the disk, so
+	//it never gets in the way of what the user is waiting on. Each only
+	//applies to this thread:
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_IDLE);
+
+	unsigned long long seen = 0;
+	while(true)
+	{
+		std::string path;
+		Progress progress;
+
+		//Waits for paths to read, or for the prefetcher to be stopped:
+		{
+			std::unique_lock <std::mutex> guard(_lock);
+			while((! _stopping) && (_paths.empty()))
+				_wake.wait(guard);
+
+			if(_stopping)
+				return;
+
+			//New paths are only read once the selection has rested on them,
+			//and replacing them again starts the wait over:
+			if(_generation != seen)
+			{
+				seen = _generation;
+				if(_wake.wait_for(guard, DELAY, [this, seen]() { return ((_stopping) || (_generation != seen)); }))
+					continue;
+			}
+
+			path = _paths.front();
+			_paths.erase(_paths.begin());
+			_progress = &progress;
+		}
+
+		Directory* dir = read(path, progress);
+
+		{
+			std::lock_guard <std::mutex> guard(_lock);
+			_progress = NULL;
+			if(dir != NULL)
+				_done.push_back(dir);
+		}
+
+		if((dir != NULL) && (_notifier != NULL))
+			_notifier->notify();
+	}
+}
+
+//Streams the directory, as that checks for the read being cancelled
+//between runs, and gives up as soon as a run takes it to too many items,
+//which are counted before each run is handed on:
+Directory* Prefetcher::read(const std::string& path, Progress& progress)
+{
+	Directory* dir = NULL;
+	try
+	{
+		dir = new Directory(path.c_str());
+		if(dir->getName() == "../")
+			dir->cleanPath();
+
+		dir->stream([this, &progress]()
+			{
+				if(progress.items >= _maxItems)
+					progress.cancel();
+			}, &progress);
+
+		unsigned int first = 0;
+		dir->merge(first);
+	}
+	catch(int e)
+	{
+		delete dir;
+		return NULL;
+	}
+	return dir;
+}
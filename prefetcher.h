@@ -0,0 +1,91 @@
+// ---
+// prefetcher.h
+//
+// Contains the class definition for the
+// prefetcher, which reads the directories
+// around the selection on a background
+// thread of its own, at the lowest priority,
+// while the user is looking at the listing,
+// so opening one of them only has to take
+// it from the listing cache. It waits for
+// the selection to rest before starting,
+// and gives up as soon as it moves on.
+// ---
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+#include "directory.h"
+#include "notifier.h"
+#include "progress.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Prefetcher
+{
+	private:
+		//The paths to read, in order, and each time they are replaced
+		//the count goes up, so the worker knows to start again:
+		std::vector <std::string> _paths;
+		unsigned long long _generation;
+
+		//The progress of the directory being read, so it can be
+		//cancelled, and the directories read but not yet collected:
+		Progress* _progress;
+		std::vector <Directory*> _done;
+
+		//The most items read of each directory:
+		unsigned int _maxItems;
+
+		//The worker thread:
+		std::thread _worker;
+
+		//Guards everything above, and wakes the worker:
+		std::mutex _lock;
+		std::condition_variable _wake;
+		bool _stopping;
+
+		//Told whenever a directory has been read, may be NULL:
+		Notifier* _notifier;
+
+		//The main loop for the worker thread:
+		void work();
+
+		//Reads the directory at the path given in full, returns NULL
+		//if it cannot be, has more items than are allowed, or the read
+		//was cancelled:
+		Directory* read(const std::string&, Progress&);
+
+	public:
+		//How long the selection has to rest before anything is read:
+		static const std::chrono::milliseconds DELAY;
+
+		//The most items read of each directory, unless set. Reading
+		//stops at the first run past it:
+		static const unsigned int MAX_ITEMS = 65536;
+
+		//Default constructor, optionally takes a notifier to tell when
+		//there are directories to collect, and the most items to read:
+		Prefetcher(Notifier* = NULL, unsigned int = MAX_ITEMS);
+
+		//Destructor, stops and joins the worker, and deletes anything
+		//read but not collected:
+		~Prefetcher();
+
+		//Replaces what is being read with the paths given, most wanted
+		//first, which are read once the delay has passed without them
+		//being replaced again:
+		void request(const std::vector <std::string>&);
+
+		//Stops reading, and drops anything waiting to be read:
+		void cancel();
+
+		//Moves the directories read into the vector passed, which the
+		//caller then owns, returns true if there were any:
+		bool collect(std::vector <Directory*>&);
+};
+
+#endif
@@ -0,0 +1,59 @@
+// --- progress.cpp
+#include "progress.h"
+#include <cerrno>
+
+Progress::Progress()
+{
+	_cancelled = false;
+	_paused = false;
+	items = 0;
+	bytes = 0;
+	totalItems = 0;
+	totalBytes = 0;
+}
+
+void Progress::cancel()
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_cancelled = true;
+	}
+	_resumed.notify_all();
+}
+
+void Progress::pause(bool paused)
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_paused = paused;
+	}
+	_resumed.notify_all();
+}
+
+//Only takes the lock when paused, so checking is cheap otherwise:
+bool Progress::check()
+{
+	if(_paused)
+	{
+		std::unique_lock <std::mutex> guard(_lock);
+		while((_paused) && (! _cancelled))
+			_resumed.wait(guard);
+	}
+
+	if(_cancelled)
+	{
+		errno = ECANCELED;
+		return false;
+	}
+	return true;
+}
+
+bool Progress::isCancelled()
+{
+	return _cancelled;
+}
+
+bool Progress::isPaused()
+{
+	return _paused;
+}
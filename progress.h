@@ -0,0 +1,58 @@
+// ---
+// progress.h
+//
+// Contains the class definition for the
+// progress of a long operation, which the
+// threads doing it add to as they go, and
+// the interface reads to show how far
+// along it is. The interface can also
+// pause or cancel the operation through
+// it, which the threads doing it check
+// between each piece of work.
+// ---
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+class Progress
+{
+	private:
+		//Set to stop the operation, or to hold it until resumed:
+		std::atomic <bool> _cancelled;
+		std::atomic <bool> _paused;
+
+		//Wakes the threads held while paused:
+		std::mutex _lock;
+		std::condition_variable _resumed;
+
+	public:
+		//The number of items and bytes done so far, and in total, where
+		//the totals are 0 if they are not known:
+		std::atomic <unsigned long long> items;
+		std::atomic <unsigned long long> bytes;
+		std::atomic <unsigned long long> totalItems;
+		std::atomic <unsigned long long> totalBytes;
+
+		//Default constructor, nothing is done yet:
+		Progress();
+
+		//Stops the operation the next time it checks, even if paused:
+		void cancel();
+
+		//Holds the operation the next time it checks, or lets it go on:
+		void pause(bool);
+
+		//Called between each piece of work. Waits while the operation is
+		//paused, and returns false with errno set to ECANCELED once it
+		//has been cancelled:
+		bool check();
+
+		//Getters:
+		bool isCancelled();
+		bool isPaused();
+};
+
+#endif
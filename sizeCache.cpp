@@ -0,0 +1,647 @@
+// --- sizeCache.cpp
+#include "sizeCache.h"
+#include "dirReader.h"
+#include "stats.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//Identifies the file, and the layout of it:
+static const char MAGIC[8] = { 't', 'r', 'i', 'l', 's', 'i', 'z', 'e' };
+static const uint32_t VERSION = 1;
+
+//The room a new cache file starts with, and the most it may grow
+//to before it is thrown away and started again:
+static const uint32_t INITIAL_RECORDS = 4096;
+static const uint64_t INITIAL_NAMES = 65536;
+static const uint32_t MAX_RECORDS = 1 << 20;
+static const uint64_t MAX_NAMES = 1 << 26;
+
+//Returns the path of the cache file, creating the directories
+//it is in if needed, or an empty string if there is nowhere to put it:
+static std::string cacheFilename()
+{
+	std::string dir;
+	const char* cache = getenv("XDG_CACHE_HOME");
+	const char* home = getenv("HOME");
+
+	if((cache != NULL) && (cache[0] == '/'))
+		dir = cache;
+	else if((home != NULL) && (home[0] == '/'))
+		dir = std::string(home) + "/.cache";
+	else
+		return "";
+
+	mkdir(dir.c_str(), 0700);
+
+	dir += "/trilobite";
+	if((mkdir(dir.c_str(), 0700) != 0) && (errno != EEXIST))
+		return "";
+
+	return dir + "/sizes";
+}
+
+
+//Returns the number of bytes needed for a file with the given room:
+size_t SizeCache::fileSize(uint32_t capacity, uint64_t namesCapacity)
+{
+	return sizeof(Header) + (capacity * sizeof(uint32_t)) + (capacity * sizeof(Record)) + namesCapacity;
+}
+
+//Returns the hash bucket a directory belongs in:
+static uint32_t bucket(dev_t dev, ino_t ino, uint32_t capacity)
+{
+	uint64_t hash = (ino * 0x9E3779B97F4A7C15ULL) ^ (dev * 0xC2B2AE3D27D4EB4FULL);
+	return ((hash >> 32) ^ hash) % capacity;
+}
+
+SizeCache::SizeCache()
+{
+	_fd = -1;
+	_map = NULL;
+	_mapSize = 0;
+
+	//If the cache cannot be opened, every lookup misses and nothing
+	//is recorded, but sizes are still calculated:
+	_filename = cacheFilename();
+	if(_filename != "")
+		open(_filename, INITIAL_RECORDS, INITIAL_NAMES);
+}
+
+SizeCache::~SizeCache()
+{
+	close();
+}
+
+//Returns the cache shared by the whole program:
+SizeCache& SizeCache::shared()
+{
+	static SizeCache cache;
+	return cache;
+}
+
+//Opens and maps the given file:
+bool SizeCache::open(const std::string& filename, uint32_t capacity, uint64_t namesCapacity)
+{
+	int fd = ::open(filename.c_str(), (O_RDWR | O_CREAT | O_CLOEXEC), 0600);
+	if(fd < 0)
+		return false;
+
+	//Only one copy of the program writes to the cache at a time,
+	//any others run without it:
+	if(flock(fd, (LOCK_EX | LOCK_NB)) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	//Checks the header of an existing file is one we understand, and
+	//that the file is as big as the header says, otherwise starts again:
+	struct stat attr;
+	Header header;
+	bool fresh = true;
+	if((fstat(fd, &attr) == 0) && (attr.st_size > (off_t)sizeof(Header)) && (pread(fd, &header, sizeof(Header), 0) == sizeof(Header)))
+	{
+		if((memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0) && (header.version == VERSION) &&
+			(header.capacity > 0) && (header.used <= header.capacity) && (header.namesUsed <= header.namesCapacity) &&
+			((size_t)attr.st_size == fileSize(header.capacity, header.namesCapacity)))
+		{
+			capacity = header.capacity;
+			namesCapacity = header.namesCapacity;
+			fresh = false;
+		}
+	}
+
+	size_t size = fileSize(capacity, namesCapacity);
+	if(fresh)
+	{
+		//Truncating to zero first means every byte starts as zero:
+		if((ftruncate(fd, 0) != 0) || (ftruncate(fd, size) != 0))
+		{
+			::close(fd);
+			return false;
+		}
+	}
+
+	void* map = mmap(NULL, size, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		::close(fd);
+		return false;
+	}
+
+	_fd = fd;
+	_map = (char*)map;
+	_mapSize = size;
+	_header = (Header*)_map;
+	_buckets = (uint32_t*)(_map + sizeof(Header));
+	_records = (Record*)(_map + sizeof(Header) + (capacity * sizeof(uint32_t)));
+	_names = (char*)(_records + capacity);
+
+	if(fresh)
+	{
+		memcpy(_header->magic, MAGIC, sizeof(MAGIC));
+		_header->version = VERSION;
+		_header->capacity = capacity;
+		_header->used = 1;
+		_header->namesCapacity = namesCapacity;
+		_header->namesUsed = 0;
+	}
+
+	return true;
+}
+
+//Unmaps and closes the file:
+void SizeCache::close()
+{
+	if(_map != NULL)
+		munmap(_map, _mapSize);
+	if(_fd >= 0)
+		::close(_fd);
+
+	_map = NULL;
+	_fd = -1;
+}
+
+//Replaces the file with a larger one:
+bool SizeCache::grow(bool records, bool names)
+{
+	uint32_t capacity = _header->capacity;
+	uint64_t namesCapacity = _header->namesCapacity;
+	if(records)
+		capacity *= 2;
+	if(names)
+		namesCapacity *= 2;
+
+	//Once the cache is as big as it is allowed to get, it is
+	//cheaper to start again than to keep the old records:
+	if((capacity > MAX_RECORDS) || (namesCapacity > MAX_NAMES))
+	{
+		close();
+		unlink(_filename.c_str());
+		return open(_filename, INITIAL_RECORDS, INITIAL_NAMES);
+	}
+
+	//Builds the new file alongside the old one:
+	std::string filename = _filename + ".new";
+	unlink(filename.c_str());
+
+	char* oldMap = _map;
+	size_t oldSize = _mapSize;
+	int oldFd = _fd;
+	Header* oldHeader = _header;
+	Record* oldRecords = _records;
+	char* oldNames = _names;
+
+	if(! open(filename, capacity, namesCapacity))
+		return false;
+
+	//The records keep their indexes, so the links between them
+	//stay valid, only the hash buckets need to be rebuilt:
+	_header->used = oldHeader->used;
+	_header->namesUsed = oldHeader->namesUsed;
+	memcpy(_records, oldRecords, (oldHeader->used * sizeof(Record)));
+	memcpy(_names, oldNames, oldHeader->namesUsed);
+
+	for(uint32_t i = 1; i < _header->used; i++)
+	{
+		uint32_t b = bucket(_records[i].dev, _records[i].ino, capacity);
+		_records[i].next = _buckets[b];
+		_buckets[b] = i;
+	}
+
+	rename(filename.c_str(), _filename.c_str());
+
+	munmap(oldMap, oldSize);
+	::close(oldFd);
+	return true;
+}
+
+//Returns the index of the record for the given directory:
+uint32_t SizeCache::find(dev_t dev, ino_t ino)
+{
+	uint32_t i = _buckets[bucket(dev, ino, _header->capacity)];
+	while((i != 0) && ((_records[i].dev != (uint64_t)dev) || (_records[i].ino != (uint64_t)ino)))
+		i = _records[i].next;
+	return i;
+}
+
+//Returns the index of the record for the given directory, adding one if needed:
+uint32_t SizeCache::insert(dev_t dev, ino_t ino)
+{
+	uint32_t i = find(dev, ino);
+	if(i != 0)
+		return i;
+
+	if((_header->used == _header->capacity) && (! grow(true, false)))
+		return 0;
+	if(_map == NULL)
+		return 0;
+
+	i = _header->used++;
+	memset(&_records[i], 0, sizeof(Record));
+	_records[i].dev = dev;
+	_records[i].ino = ino;
+
+	uint32_t b = bucket(dev, ino, _header->capacity);
+	_records[i].next = _buckets[b];
+	_buckets[b] = i;
+
+	return i;
+}
+
+//Stores a name in the name pool:
+bool SizeCache::setName(uint32_t record, const char* name, uint32_t length)
+{
+	//Nothing to do if the name has not changed:
+	if((_records[record].nameLength == length) && (memcmp(_names + _records[record].name, name, length) == 0))
+		return true;
+
+	uint32_t used = _header->used;
+	while((_header->namesUsed + length) > _header->namesCapacity)
+	{
+		if(! grow(false, true))
+			return false;
+
+		//Starting the cache again loses the record itself:
+		if((_map == NULL) || (_header->used != used))
+			return false;
+	}
+
+	memcpy(_names + _header->namesUsed, name, length);
+	_records[record].name = _header->namesUsed;
+	_records[record].nameLength = length;
+	_header->namesUsed += length;
+	return true;
+}
+
+//Marks the record's parents as needing to be walked again:
+void SizeCache::invalidateParents(uint32_t record)
+{
+	//Limits the steps taken, in case the links have gone wrong:
+	uint32_t i = _records[record].parent;
+	for(uint32_t steps = 0; (i != 0) && (steps < _header->used); steps++)
+	{
+		_records[i].complete = 0;
+		i = _records[i].parent;
+	}
+}
+
+//Checks the record still matches the directory, and so do its subdirectories:
+bool SizeCache::isValid(int fd, uint32_t record, const struct stat& attr, unsigned int& steps)
+{
+	//The record of each subdirectory, its name, and whether it has any
+	//subdirectories of its own, so needs to be opened to check them:
+	struct Child
+	{
+		uint32_t record;
+		std::string name;
+		bool parent;
+	};
+	std::vector <Child> children;
+
+	//Copies out what is needed, so the lock is not held
+	//while looking at the disk:
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		if((_map == NULL) || (record == 0) || (record >= _header->used))
+			return false;
+
+		Record& r = _records[record];
+		if((r.complete == 0) || (r.dev != (uint64_t)attr.st_dev) || (r.ino != (uint64_t)attr.st_ino) ||
+			(r.mtimeSec != attr.st_mtim.tv_sec) || (r.mtimeNsec != attr.st_mtim.tv_nsec))
+			return false;
+
+		for(uint32_t i = r.child; i != 0; i = _records[i].sibling)
+		{
+			//Gives up if the links have gone wrong and loop:
+			if(++steps > _header->used)
+				return false;
+
+			Child child;
+			child.record = i;
+			child.name.assign((_names + _records[i].name), _records[i].nameLength);
+			child.parent = (_records[i].child != 0);
+			children.push_back(child);
+		}
+	}
+
+	for(unsigned int i = 0; i < children.size(); i++)
+	{
+		struct stat childAttr;
+		if((fstatat(fd, children[i].name.c_str(), &childAttr, AT_SYMLINK_NOFOLLOW) != 0) || (S_ISDIR(childAttr.st_mode) == 0))
+			return false;
+
+		//Only directories with subdirectories need to be opened:
+		int childFd = -1;
+		if(children[i].parent)
+		{
+			childFd = openat(fd, children[i].name.c_str(), (O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+			if(childFd < 0)
+				return false;
+		}
+
+		bool valid = isValid(childFd, children[i].record, childAttr, steps);
+		if(childFd >= 0)
+			::close(childFd);
+
+		if(! valid)
+			return false;
+	}
+
+	return true;
+}
+
+//Gets the size of the directory at the given path from the cache:
+bool SizeCache::lookup(const std::string& path, unsigned long long& size)
+{
+	std::string dir = path;
+	if(dir[dir.size() - 1] != '/')
+		dir += '/';
+
+	struct stat attr;
+	if(stat(dir.c_str(), &attr) != 0)
+		return false;
+
+	uint32_t record = 0;
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		if(_map == NULL)
+			return false;
+		record = find(attr.st_dev, attr.st_ino);
+		if(record == 0)
+			return false;
+	}
+
+	int fd = ::open(dir.c_str(), (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if(fd < 0)
+		return false;
+
+	unsigned int steps = 0;
+	bool valid = isValid(fd, record, attr, steps);
+	::close(fd);
+	if(! valid)
+		return false;
+
+	//The record may have changed while it was checked:
+	std::lock_guard <std::mutex> guard(_lock);
+	if((_map == NULL) || (record >= _header->used) || (_records[record].complete == 0))
+		return false;
+
+	size = _records[record].size;
+	return true;
+}
+
+//Returns the size of the directory, walking it if the cache is out of date:
+unsigned long long SizeCache::size(const std::string& path, const std::atomic <bool>* cancelled)
+{
+	Stats::Span span(Stats::SIZE);
+
+	unsigned long long size = 0;
+	if(lookup(path, size))
+		return size;
+
+	Recorder recorder(this);
+	return Walker::shared().walk(path, &recorder, cancelled);
+}
+
+//Updates the record of a directory after something in it has changed:
+bool SizeCache::refresh(const std::string& path, long long& delta, const std::atomic <bool>* cancelled)
+{
+	Stats::Span span(Stats::SIZE);
+
+	std::string dir = path;
+	if(dir[dir.size() - 1] != '/')
+		dir += '/';
+
+	struct stat attr;
+	if(stat(dir.c_str(), &attr) != 0)
+		return false;
+
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		if(_map == NULL)
+			return false;
+
+		uint32_t record = find(attr.st_dev, attr.st_ino);
+		if((record == 0) || (_records[record].complete == 0))
+			return false;
+	}
+
+	//Reads the directory, adding up the files in it:
+	int fd = ::open(dir.c_str(), (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if(fd < 0)
+		return false;
+
+	unsigned long long size = attr.st_size;
+	std::vector <struct stat> subdirs;
+	std::vector <std::string> names;
+
+	std::vector <char> buffer(DirReader::BUFFER_SIZE);
+	DirReader reader(fd, &buffer[0], buffer.size());
+	const char* name = NULL;
+	unsigned char type = DT_UNKNOWN;
+	try
+	{
+		while(reader.next(name, type))
+		{
+			struct stat childAttr;
+			if(fstatat(fd, name, &childAttr, AT_SYMLINK_NOFOLLOW) != 0)
+				continue;
+
+			if(S_ISDIR(childAttr.st_mode) != 0)
+			{
+				subdirs.push_back(childAttr);
+				names.push_back(name);
+			}
+			else
+				size += childAttr.st_size;
+		}
+	}
+	catch(int e)
+	{
+		::close(fd);
+		return false;
+	}
+	::close(fd);
+
+	//Subdirectories are taken from their records if they have not
+	//changed themselves, as anything deeper being watched will have
+	//been refreshed on its own, otherwise they are walked:
+	for(unsigned int i = 0; i < subdirs.size(); i++)
+	{
+		bool recorded = false;
+		{
+			std::lock_guard <std::mutex> guard(_lock);
+			if(_map == NULL)
+				return false;
+
+			uint32_t child = find(subdirs[i].st_dev, subdirs[i].st_ino);
+			if((child != 0) && (_records[child].complete != 0) &&
+				(_records[child].mtimeSec == subdirs[i].st_mtim.tv_sec) && (_records[child].mtimeNsec == subdirs[i].st_mtim.tv_nsec))
+			{
+				size += _records[child].size;
+				recorded = true;
+			}
+		}
+
+		if(! recorded)
+		{
+			Recorder recorder(this);
+			try
+			{
+				size += Walker::shared().walk((dir + names[i]), &recorder, cancelled);
+			}
+			catch(int e)
+			{
+				if(e == ECANCELED)
+					return false;
+			}
+		}
+	}
+
+	std::lock_guard <std::mutex> guard(_lock);
+	if(_map == NULL)
+		return false;
+
+	uint32_t record = find(attr.st_dev, attr.st_ino);
+	if(record == 0)
+		return false;
+
+	//Relinks the subdirectories, in case any were added or removed:
+	_records[record].child = 0;
+	for(unsigned int i = 0; i < subdirs.size(); i++)
+	{
+		uint32_t child = find(subdirs[i].st_dev, subdirs[i].st_ino);
+		if(child != 0)
+		{
+			_records[child].parent = record;
+			_records[child].sibling = _records[record].child;
+			_records[record].child = child;
+		}
+	}
+
+	Record& r = _records[record];
+	delta = (long long)size - (long long)r.size;
+	r.size = size;
+	r.mtimeSec = attr.st_mtim.tv_sec;
+	r.mtimeNsec = attr.st_mtim.tv_nsec;
+	r.complete = 1;
+
+	//Passes the difference up to the parents, which are otherwise unchanged:
+	uint32_t i = r.parent;
+	for(uint32_t steps = 0; (i != 0) && (steps < _header->used); steps++)
+	{
+		_records[i].size += delta;
+		i = _records[i].parent;
+	}
+
+	return true;
+}
+
+//Adds the paths of the recorded subdirectories below the given directory:
+bool SizeCache::subdirectories(const std::string& path, std::vector <std::string>& paths, unsigned int limit)
+{
+	std::string dir = path;
+	if(dir[dir.size() - 1] != '/')
+		dir += '/';
+
+	struct stat attr;
+	if(stat(dir.c_str(), &attr) != 0)
+		return false;
+
+	std::lock_guard <std::mutex> guard(_lock);
+	if(_map == NULL)
+		return false;
+
+	uint32_t record = find(attr.st_dev, attr.st_ino);
+	if(record == 0)
+		return false;
+
+	//Goes through the records breadth first, so if the limit is
+	//reached it is the deepest directories that are left out:
+	std::vector <std::pair <uint32_t, std::string> > queue;
+	queue.push_back(std::make_pair(record, dir));
+	for(unsigned int i = 0; (i < queue.size()) && (paths.size() < limit); i++)
+	{
+		for(uint32_t child = _records[queue[i].first].child; child != 0; child = _records[child].sibling)
+		{
+			if((paths.size() >= limit) || (queue.size() > _header->used))
+				break;
+
+			std::string childPath = queue[i].second + std::string(_names + _records[child].name, _records[child].nameLength) + '/';
+			paths.push_back(childPath);
+			queue.push_back(std::make_pair(child, childPath));
+		}
+	}
+
+	return true;
+}
+
+SizeCache::Recorder::Recorder(SizeCache* cache)
+{
+	_cache = cache;
+}
+
+//Adds a record for the directory, linked to its parent's:
+void SizeCache::Recorder::entered(WalkNode* node)
+{
+	std::lock_guard <std::mutex> guard(_cache->_lock);
+	if(_cache->_map == NULL)
+		return;
+
+	uint32_t record = _cache->insert(node->attr.st_dev, node->attr.st_ino);
+	if(record == 0)
+		return;
+
+	//Walking a directory which was already recorded means its size
+	//may have changed, so the totals of its parents may be wrong:
+	if((node->parent == NULL) && (_cache->_records[record].complete != 0))
+		_cache->invalidateParents(record);
+
+	//The name is the last part of the path, which ends with a '/':
+	unsigned int end = node->path.size() - 1;
+	unsigned int start = node->path.find_last_of('/', (end - 1)) + 1;
+	if((end == 0) || (start > end))
+		start = end;
+	if(! _cache->setName(record, (node->path.c_str() + start), (end - start)))
+		return;
+
+	Record& r = _cache->_records[record];
+	r.mtimeSec = node->attr.st_mtim.tv_sec;
+	r.mtimeNsec = node->attr.st_mtim.tv_nsec;
+	r.complete = 0;
+	r.child = 0;
+
+	//Adds the directory to its parent's list of subdirectories:
+	if(node->parent != NULL)
+	{
+		uint32_t parent = _cache->find(node->parent->attr.st_dev, node->parent->attr.st_ino);
+		if(parent != 0)
+		{
+			r.parent = parent;
+			r.sibling = _cache->_records[parent].child;
+			_cache->_records[parent].child = record;
+		}
+	}
+}
+
+//Records the directory's total size:
+void SizeCache::Recorder::finished(WalkNode* node)
+{
+	std::lock_guard <std::mutex> guard(_cache->_lock);
+	if(_cache->_map == NULL)
+		return;
+
+	uint32_t record = _cache->find(node->attr.st_dev, node->attr.st_ino);
+	if(record == 0)
+		return;
+
+	_cache->_records[record].size = node->size;
+	_cache->_records[record].complete = 1;
+}
@@ -0,0 +1,175 @@
+// ---
+// sizeCache.h
+//
+// Contains the class definition for the
+// size cache, which keeps the total size
+// of every directory walked in a file under
+// $XDG_CACHE_HOME, so it survives both the
+// listing being deleted and the program
+// exiting.
+//
+// A size is only reused if the directory,
+// and every directory below it, still has
+// the same modification time it had when it
+// was walked, so checking a cached size costs
+// one stat per directory rather than one per
+// file. Changing the size of a file does not
+// change the time of the directory holding
+// it, so such a change is not noticed until
+// something is added to or removed from that
+// directory.
+// ---
+
+#ifndef SIZE_CACHE_H
+#define SIZE_CACHE_H
+#include "walker.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/stat.h>
+
+class SizeCache
+{
+	private:
+		//The start of the cache file:
+		struct Header
+		{
+			char magic[8];
+			uint32_t version;
+
+			//The number of records there is room for, which
+			//is also the number of hash buckets:
+			uint32_t capacity;
+
+			//The number of records used, including the first,
+			//which is never used so 0 can mean 'none':
+			uint32_t used;
+			uint32_t unused;
+
+			//The size of the name pool, and how much is used:
+			uint64_t namesCapacity;
+			uint64_t namesUsed;
+		};
+
+		//A walked directory:
+		struct Record
+		{
+			uint64_t dev;
+			uint64_t ino;
+			int64_t mtimeSec;
+			int64_t mtimeNsec;
+
+			//The total size of the directory and everything in it,
+			//only meaningful if 'complete' is set:
+			uint64_t size;
+			uint32_t complete;
+
+			//The next record in the same hash bucket:
+			uint32_t next;
+
+			//The directory containing this one, its first subdirectory,
+			//and the next subdirectory of its parent:
+			uint32_t parent;
+			uint32_t child;
+			uint32_t sibling;
+
+			//The directory's name, in the name pool:
+			uint32_t name;
+			uint32_t nameLength;
+		};
+
+		//Records each directory walked into the cache:
+		class Recorder : public WalkVisitor
+		{
+			private:
+				SizeCache* _cache;
+
+			public:
+				Recorder(SizeCache*);
+				void entered(WalkNode*);
+				void finished(WalkNode*);
+		};
+
+		//The cache file, and the memory it is mapped to:
+		std::string _filename;
+		int _fd;
+		char* _map;
+		size_t _mapSize;
+
+		//The parts of the mapped file:
+		Header* _header;
+		uint32_t* _buckets;
+		Record* _records;
+		char* _names;
+
+		//Guards the mapped file:
+		std::mutex _lock;
+
+		//Returns the number of bytes needed for a file with the given room:
+		static size_t fileSize(uint32_t, uint64_t);
+
+		//Opens and maps the given file, creating it with the given
+		//capacity if it does not exist, returns false on failure:
+		bool open(const std::string&, uint32_t, uint64_t);
+
+		//Unmaps and closes the file:
+		void close();
+
+		//Replaces the file with one with twice the room, keeping every
+		//record at the same index, returns false on failure:
+		bool grow(bool, bool);
+
+		//Returns the index of the record for the given directory,
+		//or 0 if there is not one:
+		uint32_t find(dev_t, ino_t);
+
+		//Returns the index of the record for the given directory,
+		//adding one if needed, or 0 if there is no room:
+		uint32_t insert(dev_t, ino_t);
+
+		//Stores a name in the name pool, returns false if there is no room:
+		bool setName(uint32_t, const char*, uint32_t);
+
+		//Marks the record's parents as needing to be walked again:
+		void invalidateParents(uint32_t);
+
+		//Checks the record still matches the directory with the given
+		//attributes, and so do all of its subdirectories, which are
+		//looked at relative to the open directory passed:
+		bool isValid(int, uint32_t, const struct stat&, unsigned int&);
+
+	public:
+		//Default constructor, opens the cache in the user's cache directory:
+		SizeCache();
+
+		//Destructor:
+		~SizeCache();
+
+		//Gets the size of the directory at the given path from the cache,
+		//returns false if it is not there or is out of date:
+		bool lookup(const std::string&, unsigned long long&);
+
+		//Returns the size of the directory at the given path, from the cache
+		//if it is up to date, otherwise by walking it and recording the result.
+		//Throws errno if it cannot be walked, as 'Walker::walk()':
+		unsigned long long size(const std::string&, const std::atomic <bool>*);
+
+		//Updates the record of the directory at the given path after
+		//something in it has changed, by reading just that directory and
+		//reusing the records of its subdirectories. The difference in size
+		//is added to the directory's parents, and passed back. Returns false
+		//if the directory was not already recorded:
+		bool refresh(const std::string&, long long&, const std::atomic <bool>*);
+
+		//Adds the paths of the recorded subdirectories below the directory
+		//at the given path, up to the given number, returns false if the
+		//directory is not recorded:
+		bool subdirectories(const std::string&, std::vector <std::string>&, unsigned int);
+
+		//Returns the cache shared by the whole program:
+		static SizeCache& shared();
+};
+
+#endif
@@ -0,0 +1,240 @@
+// --- sizer.cpp
+#include "sizer.h"
+#include "sizeCache.h"
+
+Sizer::Sizer(unsigned int threads, Notifier* notifier)
+{
+	_stopping = false;
+	_notifier = notifier;
+
+	//Always have at least one worker:
+	if(threads == 0)
+		threads = 1;
+
+	//Starts the workers, each with an empty slot:
+	for(unsigned int i = 0; i < threads; i++)
+	{
+		Slot* slot = new Slot;
+		slot->id = NONE;
+		slot->running = false;
+		slot->cancelled = false;
+		_slots.push_back(slot);
+	}
+	for(unsigned int i = 0; i < threads; i++)
+		_workers.push_back(std::thread(&Sizer::work, this, i));
+}
+
+Sizer::~Sizer()
+{
+	//Tells the workers to give up what they are doing and exit:
+	cancel();
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_stopping = true;
+	}
+	_wake.notify_all();
+
+	for(unsigned int i = 0; i < _workers.size(); i++)
+		_workers[i].join();
+
+	for(unsigned int i = 0; i < _slots.size(); i++)
+		delete _slots[i];
+}
+
+void Sizer::work(unsigned int id)
+{
+	Slot* slot = _slots[id];
+
+	while(true)
+	{
+		Job job;
+
+		//Waits for a job, or for the sizer to be stopped:
+		{
+			std::unique_lock <std::mutex> guard(_lock);
+			while((! _stopping) && (_queue.empty()))
+				_wake.wait(guard);
+
+			if(_stopping)
+				return;
+
+			job = _queue.front();
+			std::unordered_map <unsigned int, std::list <Job>::iterator>::iterator queued = _queued.find(job.id);
+			if((queued != _queued.end()) && (queued->second == _queue.begin()))
+				_queued.erase(queued);
+			_queue.pop_front();
+
+			//Jobs only updating the cache have no item to fill in:
+			slot->id = job.id;
+			slot->running = true;
+			slot->cancelled = false;
+		}
+
+		Result result;
+		result.size = 0;
+		result.delta = 0;
+		result.relative = false;
+		result.error = 0;
+
+		//Updates the cache for a directory that has changed, which
+		//gives the change in size:
+		if(job.changed != "")
+			result.relative = SizeCache::shared().refresh(job.changed, result.delta, &slot->cancelled);
+
+		//Otherwise calculates the size from the path, so the listing
+		//is only touched by whoever collects the size. Sizes that
+		//have not changed since the last walk come from the cache:
+		if((! result.relative) && (job.path != ""))
+		{
+			try
+			{
+				result.size = SizeCache::shared().size(job.path, &slot->cancelled);
+			}
+			catch(int e)
+			{
+				result.error = e;
+			}
+		}
+
+		//Hands the size or the error back, unless the job was dropped
+		//while it ran:
+		std::lock_guard <std::mutex> guard(_lock);
+		if(slot->id != NONE)
+		{
+			result.id = slot->id;
+			_done.push_back(result);
+			if(_notifier != NULL)
+				_notifier->notify();
+		}
+		slot->id = NONE;
+		slot->running = false;
+	}
+}
+
+//Adds a job to the queue, and wakes a worker for it:
+void Sizer::enqueue(const Job& job)
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_queue.push_back(job);
+		if(job.id != NONE)
+			_queued[job.id] = --_queue.end();
+	}
+	_wake.notify_one();
+}
+
+//Queues the passed item to have its size calculated:
+void Sizer::request(unsigned int id, const std::string& path)
+{
+	Job job;
+	job.id = id;
+	job.path = path;
+
+	enqueue(job);
+}
+
+//Queues a changed directory to have its cached size updated:
+void Sizer::refresh(unsigned int id, const std::string& path, const std::string& changed)
+{
+	Job job;
+	job.id = id;
+	if(id != NONE)
+		job.path = path;
+	job.changed = changed;
+
+	enqueue(job);
+}
+
+//Moves the queued jobs for the passed items to the front, in the
+//order given. Only the ids passed are looked up, so this costs the
+//same however many jobs are waiting:
+void Sizer::prioritise(const std::vector <unsigned int>& ids)
+{
+	std::lock_guard <std::mutex> guard(_lock);
+	for(std::vector <unsigned int>::const_reverse_iterator i = ids.rbegin(); i != ids.rend(); i++)
+	{
+		std::unordered_map <unsigned int, std::list <Job>::iterator>::iterator queued = _queued.find(*i);
+		if(queued != _queued.end())
+			_queue.splice(_queue.begin(), _queue, queued->second);
+	}
+}
+
+//Drops any pending work for the passed id:
+void Sizer::forget(unsigned int id)
+{
+	std::lock_guard <std::mutex> guard(_lock);
+
+	//Removes it from the queue:
+	_queued.erase(id);
+	for(std::list <Job>::iterator i = _queue.begin(); i != _queue.end();)
+	{
+		if(i->id == id)
+			i = _queue.erase(i);
+		else
+			i++;
+	}
+
+	//Removes any result waiting to be collected:
+	for(std::vector <Result>::iterator i = _done.begin(); i != _done.end();)
+	{
+		if(i->id == id)
+			i = _done.erase(i);
+		else
+			i++;
+	}
+
+	//Stops any worker currently sizing it:
+	for(unsigned int i = 0; i < _slots.size(); i++)
+	{
+		if(_slots[i]->id == id)
+		{
+			_slots[i]->id = NONE;
+			_slots[i]->cancelled = true;
+		}
+	}
+}
+
+//Drops all pending work:
+void Sizer::cancel()
+{
+	std::lock_guard <std::mutex> guard(_lock);
+
+	_queue.clear();
+	_queued.clear();
+	_done.clear();
+
+	for(unsigned int i = 0; i < _slots.size(); i++)
+	{
+		if(_slots[i]->running)
+		{
+			_slots[i]->id = NONE;
+			_slots[i]->cancelled = true;
+		}
+	}
+}
+
+//Hands over the finished jobs:
+bool Sizer::collect(std::vector <Result>& results)
+{
+	std::lock_guard <std::mutex> guard(_lock);
+
+	results.insert(results.end(), _done.begin(), _done.end());
+	bool changed = (_done.size() > 0);
+	_done.clear();
+	return changed;
+}
+
+//Returns true if there are jobs queued or running:
+bool Sizer::busy()
+{
+	std::lock_guard <std::mutex> guard(_lock);
+
+	if((_queue.size() > 0) || (_done.size() > 0))
+		return true;
+
+	for(unsigned int i = 0; i < _slots.size(); i++)
+		if(_slots[i]->running)
+			return true;
+
+	return false;
+}
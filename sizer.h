@@ -0,0 +1,127 @@
+// ---
+// sizer.h
+//
+// Contains the class definition for the
+// sizer, which calculates the sizes of
+// directories on background threads so
+// reading a directory does not have to
+// wait on a walk of every subdirectory.
+// ---
+
+#ifndef SIZER_H
+#define SIZER_H
+#include "notifier.h"
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Sizer
+{
+	private:
+		//A request to size the item with the given id. If
+		//'changed' is set, it is a directory somewhere in the
+		//item that has changed, and only it is read again:
+		struct Job
+		{
+			unsigned int id;
+			std::string path;
+			std::string changed;
+		};
+
+		//The job each worker is currently running, and a flag
+		//used to tell the worker to give up on it:
+		struct Slot
+		{
+			unsigned int id;
+			bool running;
+			std::atomic <bool> cancelled;
+		};
+
+	public:
+		//A finished job, waiting to be collected. Refreshes
+		//give the change in size rather than the size, and a
+		//job which could not size its item gives the errno:
+		struct Result
+		{
+			unsigned int id;
+			unsigned long long size;
+			long long delta;
+			bool relative;
+			int error;
+		};
+
+		//The id of a job with no item to fill in:
+		static const unsigned int NONE = 0xFFFFFFFF;
+
+	private:
+		//The jobs waiting for a worker, from most to least urgent,
+		//and the last job queued for each id, so the jobs for the
+		//rows on screen can be found without going through them all:
+		std::list <Job> _queue;
+		std::unordered_map <unsigned int, std::list <Job>::iterator> _queued;
+
+		//Adds a job to the back of the queue:
+		void enqueue(const Job&);
+
+		//The jobs which have finished:
+		std::vector <Result> _done;
+
+		//The worker threads, and what each is working on:
+		std::vector <std::thread> _workers;
+		std::vector <Slot*> _slots;
+
+		//Guards everything above, and wakes idle workers:
+		std::mutex _lock;
+		std::condition_variable _wake;
+		bool _stopping;
+
+		//Told whenever a job finishes, may be NULL:
+		Notifier* _notifier;
+
+		//The main loop for each of the worker threads:
+		void work(unsigned int);
+
+	public:
+		//Default constructor, takes the number of worker threads, and
+		//optionally a notifier to tell when there are sizes to collect:
+		Sizer(unsigned int, Notifier* = NULL);
+
+		//Destructor, stops and joins the workers:
+		~Sizer();
+
+		//Queues the item with the given id and path to have its
+		//size calculated. The id is the caller's, and is handed
+		//back with the size:
+		void request(unsigned int, const std::string&);
+
+		//Queues the last directory given, which has changed, to have
+		//its cached size updated, and the change given for the item
+		//with the id and path passed. The id may be NONE if only the
+		//cache needs updating:
+		void refresh(unsigned int, const std::string&, const std::string&);
+
+		//Moves any queued jobs for the passed ids to the front:
+		void prioritise(const std::vector <unsigned int>&);
+
+		//Drops any pending work for the passed id, must be called
+		//before the id is given to something else:
+		void forget(unsigned int);
+
+		//Drops all pending work, must be called before the ids it
+		//was requested for are given to something else:
+		void cancel();
+
+		//Moves the finished jobs into the vector passed, returns
+		//true if there were any:
+		bool collect(std::vector <Result>&);
+
+		//Returns true if there are jobs queued or running:
+		bool busy();
+};
+
+#endif
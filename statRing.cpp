@@ -0,0 +1,272 @@
+// --- statRing.cpp
+#include "statRing.h"
+#include "stats.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+std::atomic <bool> StatRing::_disabled(false);
+
+//The number of requests kept in flight at once:
+static const unsigned int ENTRIES = 256;
+
+//Only asks for what a listing uses, so filesystems that have
+//to work hard for the rest of the attributes do not bother:
+static const unsigned int MASK = (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_INO | STATX_MTIME);
+
+static int ioUringSetup(unsigned int entries, struct io_uring_params* params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int fd, unsigned int submit, unsigned int complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+
+//Fills in the parts of a struct stat that a statx asked for:
+static void toStat(const struct statx& from, struct stat& to)
+{
+	memset(&to, 0, sizeof(to));
+	to.st_dev = makedev(from.stx_dev_major, from.stx_dev_minor);
+	to.st_ino = from.stx_ino;
+	to.st_mode = from.stx_mode;
+	to.st_nlink = from.stx_nlink;
+	to.st_uid = from.stx_uid;
+	to.st_gid = from.stx_gid;
+	to.st_size = from.stx_size;
+	to.st_blksize = from.stx_blksize;
+	to.st_blocks = from.stx_blocks;
+	to.st_atim.tv_sec = from.stx_atime.tv_sec;
+	to.st_atim.tv_nsec = from.stx_atime.tv_nsec;
+	to.st_mtim.tv_sec = from.stx_mtime.tv_sec;
+	to.st_mtim.tv_nsec = from.stx_mtime.tv_nsec;
+	to.st_ctim.tv_sec = from.stx_ctime.tv_sec;
+	to.st_ctim.tv_nsec = from.stx_ctime.tv_nsec;
+}
+
+StatRing::StatRing(unsigned int entries)
+{
+	_fd = -1;
+	_sqMap = MAP_FAILED;
+	_cqMap = MAP_FAILED;
+	_sqes = MAP_FAILED;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	_fd = ioUringSetup(entries, &params);
+	if(_fd < 0)
+		return;
+
+	_entries = params.sq_entries;
+
+	//Maps the submission and completion rings, which newer kernels
+	//let share a single mapping:
+	_sqMapSize = params.sq_off.array + (params.sq_entries * sizeof(uint32_t));
+	_cqMapSize = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(_cqMapSize > _sqMapSize)
+			_sqMapSize = _cqMapSize;
+		_cqMapSize = 0;
+	}
+
+	_sqMap = mmap(NULL, _sqMapSize, (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_POPULATE), _fd, IORING_OFF_SQ_RING);
+	if(_sqMap == MAP_FAILED)
+		return;
+
+	if(_cqMapSize == 0)
+		_cqMap = _sqMap;
+	else
+	{
+		_cqMap = mmap(NULL, _cqMapSize, (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_POPULATE), _fd, IORING_OFF_CQ_RING);
+		if(_cqMap == MAP_FAILED)
+			return;
+	}
+
+	_sqes = mmap(NULL, (params.sq_entries * sizeof(struct io_uring_sqe)), (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_POPULATE), _fd, IORING_OFF_SQES);
+	if(_sqes == MAP_FAILED)
+		return;
+
+	char* sq = (char*)_sqMap;
+	_sqHead = (std::atomic <uint32_t>*)(sq + params.sq_off.head);
+	_sqTail = (std::atomic <uint32_t>*)(sq + params.sq_off.tail);
+	_sqMask = (uint32_t*)(sq + params.sq_off.ring_mask);
+	_sqArray = (uint32_t*)(sq + params.sq_off.array);
+
+	char* cq = (char*)_cqMap;
+	_cqHead = (std::atomic <uint32_t>*)(cq + params.cq_off.head);
+	_cqTail = (std::atomic <uint32_t>*)(cq + params.cq_off.tail);
+	_cqMask = (uint32_t*)(cq + params.cq_off.ring_mask);
+	_cqes = (cq + params.cq_off.cqes);
+}
+
+StatRing::~StatRing()
+{
+	if(_sqes != MAP_FAILED)
+		munmap(_sqes, (_entries * sizeof(struct io_uring_sqe)));
+	if((_cqMap != MAP_FAILED) && (_cqMap != _sqMap))
+		munmap(_cqMap, _cqMapSize);
+	if(_sqMap != MAP_FAILED)
+		munmap(_sqMap, _sqMapSize);
+	if(_fd >= 0)
+		close(_fd);
+}
+
+//Returns false if the ring could not be set up:
+bool StatRing::isReady()
+{
+	return ((_fd >= 0) && (_sqes != MAP_FAILED));
+}
+
+//Stops io_uring being used by anything from now on:
+void StatRing::disable()
+{
+	_disabled = true;
+}
+
+//Returns the ring for the calling thread:
+StatRing* StatRing::get()
+{
+	//Each thread gets its own ring, made the first time it is needed,
+	//and torn down when the thread exits:
+	struct Holder
+	{
+		StatRing* ring;
+		bool tried;
+		~Holder() { delete ring; }
+	};
+	static thread_local Holder holder = { NULL, false };
+
+	if(_disabled)
+		return NULL;
+
+	if(! holder.tried)
+	{
+		holder.tried = true;
+		holder.ring = new StatRing(ENTRIES);
+		if(! holder.ring->isReady())
+		{
+			delete holder.ring;
+			holder.ring = NULL;
+			disable();
+		}
+	}
+	return holder.ring;
+}
+
+//Stats each of the named items relative to the open directory:
+bool StatRing::stat(int dirfd, const std::vector <const char*>& names, bool follow, std::vector <struct stat>& attrs, std::vector <int>& errors)
+{
+	unsigned int count = names.size();
+	attrs.resize(count);
+	errors.assign(count, 0);
+
+	//The kernel writes the results here, one per item in flight, which
+	//are converted as they complete so only a ring's worth is needed:
+	struct statx* results = new struct statx[_entries];
+	std::vector <unsigned int> slots;
+	for(unsigned int i = 0; i < _entries; i++)
+		slots.push_back(i);
+
+	struct io_uring_sqe* sqes = (struct io_uring_sqe*)_sqes;
+	struct io_uring_cqe* cqes = (struct io_uring_cqe*)_cqes;
+
+	//The requests written to the ring but not yet taken by the kernel,
+	//and those it has taken which have not completed. Any left written
+	//are always submitted, even once it has failed, or the next stat
+	//would submit them with results long since freed:
+	unsigned int next = 0;
+	unsigned int pending = 0;
+	unsigned int inFlight = 0;
+	bool failed = false;
+	while(((next < count) && (! failed)) || (pending > 0) || (inFlight > 0))
+	{
+		//Fills every free slot with the next items:
+		unsigned int submit = 0;
+		uint32_t tail = _sqTail->load(std::memory_order_relaxed);
+		while((next < count) && (! failed) && (! slots.empty()))
+		{
+			unsigned int slot = slots.back();
+			slots.pop_back();
+
+			uint32_t index = tail & *_sqMask;
+			struct io_uring_sqe* sqe = &sqes[index];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = dirfd;
+			sqe->addr = (uint64_t)names[next];
+			sqe->len = MASK;
+			sqe->off = (uint64_t)&results[slot];
+			sqe->statx_flags = (follow ? 0 : AT_SYMLINK_NOFOLLOW);
+
+			//The slot and the item are packed together, so completions
+			//can be matched up in whatever order they arrive:
+			sqe->user_data = (((uint64_t)next << 32) | slot);
+
+			_sqArray[index] = index;
+			tail++;
+			next++;
+			submit++;
+		}
+		_sqTail->store(tail, std::memory_order_release);
+		pending += submit;
+
+		//Submits every request not yet taken, waiting for at least one to
+		//complete. The kernel may take fewer than it is given, in which
+		//case it does not wait, and the rest are given again next time.
+		//If it is interrupted, or busy until completions are collected,
+		//it takes none:
+		Stats::count(Stats::SYSCALLS);
+		int taken = ioUringEnter(_fd, pending, 1, IORING_ENTER_GETEVENTS);
+		if(taken < 0)
+		{
+			if((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+			{
+				//Requests may still be in flight, so the kernel could yet
+				//write to the results, which are left allocated:
+				disable();
+				return false;
+			}
+			taken = 0;
+		}
+		pending -= taken;
+		inFlight += taken;
+
+		//Collects everything that has completed:
+		uint32_t head = _cqHead->load(std::memory_order_relaxed);
+		while(head != _cqTail->load(std::memory_order_acquire))
+		{
+			struct io_uring_cqe* cqe = &cqes[head & *_cqMask];
+			unsigned int item = (cqe->user_data >> 32);
+			unsigned int slot = (cqe->user_data & 0xFFFFFFFF);
+
+			//Kernels without statx in io_uring reject it outright, in
+			//which case what is in flight is waited for, then given up:
+			if(cqe->res == -EINVAL)
+				failed = true;
+			else if(cqe->res < 0)
+				errors[item] = -cqe->res;
+			else
+				toStat(results[slot], attrs[item]);
+
+			slots.push_back(slot);
+			inFlight--;
+			head++;
+		}
+		_cqHead->store(head, std::memory_order_release);
+	}
+
+	delete[] results;
+	if(failed)
+	{
+		disable();
+		return false;
+	}
+	return true;
+}
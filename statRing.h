@@ -0,0 +1,76 @@
+// ---
+// statRing.h
+//
+// Contains the class definition for the
+// stat ring, which uses io_uring to stat
+// many items in a directory at once, so a
+// directory with a huge number of items,
+// or on a slow or network filesystem, does
+// not have to wait for each stat in turn.
+// Where io_uring cannot be used, it says so,
+// and callers stat the items one at a time.
+// ---
+
+#ifndef STAT_RING_H
+#define STAT_RING_H
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+class StatRing
+{
+	private:
+		//The ring, and its size:
+		int _fd;
+		unsigned int _entries;
+
+		//The memory shared with the kernel:
+		void* _sqMap;
+		void* _cqMap;
+		void* _sqes;
+		size_t _sqMapSize;
+		size_t _cqMapSize;
+
+		//The parts of the submission and completion rings:
+		std::atomic <uint32_t>* _sqHead;
+		std::atomic <uint32_t>* _sqTail;
+		uint32_t* _sqMask;
+		uint32_t* _sqArray;
+		std::atomic <uint32_t>* _cqHead;
+		std::atomic <uint32_t>* _cqTail;
+		uint32_t* _cqMask;
+		void* _cqes;
+
+		//Set once io_uring has been found not to work:
+		static std::atomic <bool> _disabled;
+
+	public:
+		//Default constructor, takes the number of requests in flight:
+		StatRing(unsigned int);
+
+		//Destructor, tears the ring down:
+		~StatRing();
+
+		//Returns false if the ring could not be set up:
+		bool isReady();
+
+		//The fewest items worth using the ring for:
+		static const unsigned int THRESHOLD = 1024;
+
+		//Stats each of the named items relative to the open directory,
+		//following links if told to, filling in the matching attributes,
+		//or setting the matching error to errno if it could not be
+		//stat'ed. Returns false if io_uring could not be used at all:
+		bool stat(int, const std::vector <const char*>&, bool, std::vector <struct stat>&, std::vector <int>&);
+
+		//Returns the ring for the calling thread, or NULL if there
+		//is not one because io_uring cannot be used:
+		static StatRing* get();
+
+		//Stops io_uring being used by anything from now on:
+		static void disable();
+};
+
+#endif
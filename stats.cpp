@@ -0,0 +1,140 @@
+// --- stats.cpp
+#include "stats.h"
+#include <cerrno>
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+std::atomic <uint64_t> Stats::_counters[COUNTERS];
+std::atomic <uint64_t> Stats::_totals[TIMERS];
+std::atomic <uint64_t> Stats::_lasts[TIMERS];
+std::atomic <uint64_t> Stats::_spans[TIMERS];
+std::atomic <bool> Stats::_tracing(false);
+
+//The names of the timers and counters, as they appear in the trace:
+static const char* TIMER_NAMES[] = { "read", "sort", "size", "paste", "delete", "frame" };
+static const char* COUNTER_NAMES[] = { "scanned", "syscalls", "copied", "deleted" };
+
+//The trace file, the time it was started, and the lock each span
+//takes to write to it:
+static FILE* file = NULL;
+static int64_t started = 0;
+static std::mutex lock;
+
+//The id of the calling thread, looked up once:
+static thread_local long tid = 0;
+
+Stats::Span::Span(Timer timer)
+{
+	_timer = timer;
+	_start = now();
+}
+
+Stats::Span::~Span()
+{
+	add(_timer, _start, now());
+}
+
+void Stats::count(Counter counter, uint64_t amount)
+{
+	_counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void Stats::add(Timer timer, int64_t start, int64_t end)
+{
+	uint64_t length = end - start;
+	_totals[timer].fetch_add(length, std::memory_order_relaxed);
+	_lasts[timer].store(length, std::memory_order_relaxed);
+	_spans[timer].fetch_add(1, std::memory_order_relaxed);
+
+	if(_tracing.load(std::memory_order_relaxed))
+		write(timer, start, end);
+}
+
+uint64_t Stats::get(Counter counter)
+{
+	return _counters[counter].load(std::memory_order_relaxed);
+}
+
+uint64_t Stats::getTotal(Timer timer)
+{
+	return _totals[timer].load(std::memory_order_relaxed);
+}
+
+uint64_t Stats::getLast(Timer timer)
+{
+	return _lasts[timer].load(std::memory_order_relaxed);
+}
+
+uint64_t Stats::getSpans(Timer timer)
+{
+	return _spans[timer].load(std::memory_order_relaxed);
+}
+
+//Opens the trace, and starts the array of events:
+bool Stats::trace(const std::string& path)
+{
+	std::lock_guard <std::mutex> guard(lock);
+	if(file != NULL)
+		return true;
+
+	file = fopen(path.c_str(), "we");
+	if(file == NULL)
+		return false;
+
+	fprintf(file, "[\n");
+	started = now();
+	_tracing = true;
+	return true;
+}
+
+//Writes a counter event with the total of each counter:
+void Stats::sample()
+{
+	if(! _tracing)
+		return;
+
+	std::lock_guard <std::mutex> guard(lock);
+	if(file == NULL)
+		return;
+
+	fprintf(file, "{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"args\":{", ((now() - started) / 1000.0), (int)getpid());
+	for(unsigned int i = 0; i < COUNTERS; i++)
+		fprintf(file, "%s\"%s\":%llu", ((i > 0) ? "," : ""), COUNTER_NAMES[i], (unsigned long long)get((Counter)i));
+	fprintf(file, "}},\n");
+}
+
+//Ends the array of events, with one naming the process, and closes the
+//trace. The viewers also open a trace cut short without the end:
+void Stats::finish()
+{
+	std::lock_guard <std::mutex> guard(lock);
+	if(file == NULL)
+		return;
+
+	_tracing = false;
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"trilobite\"}}\n]\n", (int)getpid());
+	fclose(file);
+	file = NULL;
+}
+
+int64_t Stats::now()
+{
+	return std::chrono::duration_cast <std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Writes a complete event, with its start and length in microseconds:
+void Stats::write(Timer timer, int64_t start, int64_t end)
+{
+	if(tid == 0)
+		tid = syscall(SYS_gettid);
+
+	std::lock_guard <std::mutex> guard(lock);
+	if(file == NULL)
+		return;
+
+	fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld},\n", TIMER_NAMES[timer],
+		((start - started) / 1000.0), ((end - start) / 1000.0), (int)getpid(), tid);
+}
@@ -0,0 +1,92 @@
+// ---
+// stats.h
+//
+// Contains the class definition for the
+// stats, counters and timers kept around
+// the busiest parts of the program, cheap
+// enough to always be on: each count is a
+// single add, and each timer reads the
+// clock twice. If asked, each timed span
+// is also written to a trace file, which
+// Chrome's and Perfetto's trace viewers
+// can open.
+// ---
+
+#ifndef STATS_H
+#define STATS_H
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+class Stats
+{
+	public:
+		//The things counted: directory entries read, system calls
+		//made by the busiest paths, bytes copied and items deleted:
+		enum Counter { SCANNED, SYSCALLS, COPIED, DELETED };
+		static const unsigned int COUNTERS = 4;
+
+		//The things timed: reading a directory, sorting a listing,
+		//sizing a directory, pasting, deleting and drawing a frame:
+		enum Timer { READ, SORT, SIZE, PASTE, DELETE, FRAME };
+		static const unsigned int TIMERS = 6;
+
+		//Times the code from where it is made until it goes out of
+		//scope, adding it to the timer given:
+		class Span
+		{
+			private:
+				Timer _timer;
+				int64_t _start;
+
+			public:
+				Span(Timer);
+				~Span();
+		};
+
+		//Adds to the counter given, from any thread:
+		static void count(Counter, uint64_t = 1);
+
+		//Adds a span to the timer given, from when it started to when
+		//it ended, for code which cannot be timed with a 'Span':
+		static void add(Timer, int64_t, int64_t);
+
+		//Returns the total of the counter given:
+		static uint64_t get(Counter);
+
+		//Returns the total time, and the time of the last span, of
+		//the timer given, in nanoseconds:
+		static uint64_t getTotal(Timer);
+		static uint64_t getLast(Timer);
+
+		//Returns the number of spans the timer given has timed:
+		static uint64_t getSpans(Timer);
+
+		//Starts writing every span timed to the file given, returns
+		//false, with errno set, if it cannot be created:
+		static bool trace(const std::string&);
+
+		//Writes the counters to the trace, if there is one:
+		static void sample();
+
+		//Finishes the trace, if there is one:
+		static void finish();
+
+		//Returns the time now, in nanoseconds from an arbitrary start:
+		static int64_t now();
+
+	private:
+		//The counters, and the totals, lasts and spans of the timers:
+		static std::atomic <uint64_t> _counters[COUNTERS];
+		static std::atomic <uint64_t> _totals[TIMERS];
+		static std::atomic <uint64_t> _lasts[TIMERS];
+		static std::atomic <uint64_t> _spans[TIMERS];
+
+		//True while a trace is being written:
+		static std::atomic <bool> _tracing;
+
+		//Writes a span to the trace:
+		static void write(Timer, int64_t, int64_t);
+};
+
+#endif
@@ -0,0 +1,404 @@
+// --- treeCopier.cpp
+#include "treeCopier.h"
+#include "copier.h"
+#include "treeDeleter.h"
+#include "stats.h"
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+
+TreeCopier::TreeCopier(unsigned int threads, Progress* progress)
+{
+	_progress = progress;
+	_running = 0;
+	_idle = 0;
+	_cloning = true;
+	_base = NULL;
+	_stopping = false;
+	_failed = false;
+	_error = 0;
+
+	//Always have at least one worker:
+	if(threads == 0)
+		threads = 1;
+
+	for(unsigned int i = 0; i < threads; i++)
+		_workers.push_back(std::thread(&TreeCopier::work, this));
+}
+
+TreeCopier::~TreeCopier()
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_stopping = true;
+	}
+	_wake.notify_all();
+
+	for(unsigned int i = 0; i < _workers.size(); i++)
+		_workers[i].join();
+}
+
+//Copies the tree, walking it on a walker of its own, so a long copy
+//does not hold up the sizes being walked on the shared one:
+bool TreeCopier::copy(const std::string& from, const std::string& to)
+{
+	Stats::Span span(Stats::PASTE);
+
+	setPaths(from, to);
+	{
+		Walker walker(Walker::getThreads());
+		try
+		{
+			walker.walk(_from, this, &_failed);
+		}
+		catch(int e)
+		{
+			fail(e);
+		}
+	}
+
+	return finish();
+}
+
+//Copies a batch of items, walking each directory in turn on one walker,
+//while the other items are queued straight to the workers:
+bool TreeCopier::copy(int fd, const std::string& from, const std::vector <std::string>& names, const std::string& to)
+{
+	Stats::Span span(Stats::PASTE);
+
+	setPaths(from, to);
+
+	Target base;
+	base.parent = NULL;
+	base.path = _to;
+	base.pending = 1;
+	_base = &base;
+
+	{
+		Walker walker(Walker::getThreads());
+		for(unsigned int i = 0; (i < names.size()) && (! _failed); i++)
+		{
+			struct stat attr;
+			if(fstatat(fd, names[i].c_str(), &attr, AT_SYMLINK_NOFOLLOW) != 0)
+			{
+				fail(errno);
+				break;
+			}
+
+			if(S_ISDIR(attr.st_mode) != 0)
+			{
+				try
+				{
+					walker.walk((_from + names[i] + '/'), this, &_failed);
+				}
+				catch(int e)
+				{
+					fail(e);
+				}
+			}
+			else
+			{
+				Task task;
+				task.target = &base;
+				task.fd = fd;
+				task.from = names[i];
+				task.name = names[i];
+				task.attr = attr;
+				queue(task);
+			}
+		}
+	}
+
+	bool copied = finish();
+	_base = NULL;
+	return copied;
+}
+
+void TreeCopier::setPaths(const std::string& from, const std::string& to)
+{
+	_from = from;
+	if(_from[_from.size() - 1] != '/')
+		_from += '/';
+	_to = to;
+	if(_to[_to.size() - 1] != '/')
+		_to += '/';
+}
+
+//Waits for the workers to copy whatever is left:
+bool TreeCopier::finish()
+{
+	{
+		std::unique_lock <std::mutex> guard(_lock);
+		while((! _queue.empty()) || (_running > 0))
+			_room.wait(guard);
+	}
+
+	for(unsigned int i = 0; i < _targets.size(); i++)
+		delete _targets[i];
+	_targets.clear();
+
+	if(! _failed)
+	{
+		_made.clear();
+		return true;
+	}
+
+	//A cancelled copy is not left half done:
+	if(_error == ECANCELED)
+	{
+		for(unsigned int i = 0; i < _made.size(); i++)
+		{
+			struct stat attr;
+			if((lstat(_made[i].c_str(), &attr) == 0) && (S_ISDIR(attr.st_mode) != 0))
+			{
+				TreeDeleter deleter(NULL);
+				deleter.remove(_made[i]);
+			}
+			else
+				unlink(_made[i].c_str());
+		}
+	}
+	_made.clear();
+
+	errno = _error;
+	return false;
+}
+
+//Creates the directory being entered, so the walk only ever goes
+//ahead of the copy into directories which are already there:
+void TreeCopier::entered(WalkNode* node)
+{
+	Target* target = new Target;
+	target->parent = (node->parent != NULL) ? (Target*)node->parent->data : NULL;
+	target->path = _to + node->path.substr(_from.size());
+	target->attr = node->attr;
+	target->pending = 1;
+	node->data = target;
+
+	if(target->parent != NULL)
+		target->parent->pending++;
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_targets.push_back(target);
+	}
+
+	//Only the owner can use it until everything is in it, then it
+	//is given the original's mode:
+	Stats::count(Stats::SYSCALLS);
+	if(mkdir(target->path.c_str(), 0700) != 0)
+		fail(errno);
+	else if(target->parent == NULL)
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_made.push_back(target->path);
+	}
+
+	//Its size is counted as done, as it is in the size of the tree:
+	if(_progress != NULL)
+		_progress->bytes += node->attr.st_size;
+}
+
+//Queues an item the walk has found:
+void TreeCopier::file(WalkNode* node, const char* name, const struct stat& attr)
+{
+	Task task;
+	task.target = (Target*)node->data;
+	task.fd = AT_FDCWD;
+	task.from = node->path + name;
+	task.name = name;
+	task.attr = attr;
+	queue(task);
+}
+
+//Queues an item to be copied by the workers, waiting if too many
+//already are:
+void TreeCopier::queue(Task& task)
+{
+	//The walk waits here while the copy is paused:
+	if((_progress != NULL) && (! _progress->check()))
+	{
+		fail(errno);
+		return;
+	}
+
+	task.target->pending++;
+
+	//Only wakes a worker if one is asleep, which saves a system
+	//call for every file while they are all busy:
+	std::unique_lock <std::mutex> guard(_lock);
+	while((_queue.size() >= QUEUE_LIMIT) && (! _failed))
+		_room.wait(guard);
+	_queue.push_back(task);
+	if(_idle > 0)
+		_wake.notify_one();
+}
+
+//The directory has been walked:
+void TreeCopier::finished(WalkNode* node)
+{
+	release((Target*)node->data);
+}
+
+//A directory which cannot be read cannot be copied:
+void TreeCopier::failed(WalkNode* node, int error)
+{
+	fail(error);
+}
+
+void TreeCopier::work()
+{
+	while(true)
+	{
+		Task task;
+		{
+			std::unique_lock <std::mutex> guard(_lock);
+			_idle++;
+			while((! _stopping) && (_queue.empty()))
+				_wake.wait(guard);
+			_idle--;
+
+			if(_queue.empty())
+				return;
+
+			task = _queue.front();
+			_queue.pop_front();
+			_running++;
+
+			//Wakes the walk if it was waiting for room:
+			if(_queue.size() == (QUEUE_LIMIT - 1))
+				_room.notify_all();
+		}
+
+		//Once anything has failed, the rest is skipped:
+		if(! _failed)
+		{
+			if((_progress != NULL) && (! _progress->check()))
+				fail(errno);
+			else if(! copyItem(task))
+				fail(errno);
+			else if(_progress != NULL)
+				_progress->items++;
+		}
+		release(task.target);
+
+		std::lock_guard <std::mutex> guard(_lock);
+		_running--;
+		if((_running == 0) && (_queue.empty()))
+			_room.notify_all();
+	}
+}
+
+//Copies a file's data, or makes a new link or special file, keeping
+//its mode and times:
+bool TreeCopier::copyItem(const Task& task)
+{
+	std::string to = task.target->path + task.name;
+	const struct stat& attr = task.attr;
+	struct timespec times[2] = { attr.st_atim, attr.st_mtim };
+
+	if(S_ISREG(attr.st_mode) != 0)
+	{
+		//Opening both files, setting the copy's mode and times, and
+		//closing both again, around the copy itself:
+		Stats::count(Stats::SYSCALLS, 6);
+		int in = openat(task.fd, task.from.c_str(), (O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+		if(in < 0)
+			return false;
+
+		int out = open(to.c_str(), (O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC), 0600);
+		if(out < 0)
+		{
+			int error = errno;
+			close(in);
+			errno = error;
+			return false;
+		}
+		made(task, to);
+
+		Copier::Method method = (_cloning) ? Copier::CLONE : Copier::COPY_RANGE;
+		bool copied = ((Copier::copy(in, out, attr, method, _progress)) && (fchmod(out, (attr.st_mode & 07777)) == 0) &&
+			(futimens(out, times) == 0));
+
+		if(method != Copier::CLONE)
+			_cloning = false;
+
+		int error = errno;
+		close(in);
+		if((close(out) != 0) && (copied))
+		{
+			error = errno;
+			copied = false;
+		}
+		errno = error;
+		return copied;
+	}
+
+	//Links are made again, pointing at the same place, rather than
+	//copying what they point to:
+	if(S_ISLNK(attr.st_mode) != 0)
+	{
+		char link[PATH_MAX];
+		ssize_t length = readlinkat(task.fd, task.from.c_str(), link, (sizeof(link) - 1));
+		if(length < 0)
+			return false;
+		link[length] = '\0';
+
+		if(symlink(link, to.c_str()) != 0)
+			return false;
+		made(task, to);
+		if(_progress != NULL)
+			_progress->bytes += attr.st_size;
+		return (utimensat(AT_FDCWD, to.c_str(), times, AT_SYMLINK_NOFOLLOW) == 0);
+	}
+
+	//Anything else, like a pipe, is made again empty:
+	if(mknod(to.c_str(), attr.st_mode, attr.st_rdev) != 0)
+		return false;
+	made(task, to);
+	return (utimensat(AT_FDCWD, to.c_str(), times, 0) == 0);
+}
+
+//Notes an item made straight into the directory a batch is copied into:
+void TreeCopier::made(const Task& task, const std::string& path)
+{
+	if(task.target == _base)
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_made.push_back(path);
+	}
+}
+
+//Gives each directory whose contents have all been copied its mode
+//and times, which has to wait until then, as copying into it would
+//change its times, and its mode may not allow it:
+void TreeCopier::release(Target* target)
+{
+	while((target != NULL) && (--target->pending == 0))
+	{
+		if(! _failed)
+		{
+			struct timespec times[2] = { target->attr.st_atim, target->attr.st_mtim };
+			if((chmod(target->path.c_str(), (target->attr.st_mode & 07777)) != 0) ||
+				(utimensat(AT_FDCWD, target->path.c_str(), times, 0) != 0))
+				fail(errno);
+			else if(_progress != NULL)
+				_progress->items++;
+		}
+		target = target->parent;
+	}
+}
+
+//Keeps the first error, which stops the walk:
+void TreeCopier::fail(int error)
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		if(! _failed)
+		{
+			_error = error;
+			_failed = true;
+		}
+	}
+	_room.notify_all();
+}
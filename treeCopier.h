@@ -0,0 +1,151 @@
+// ---
+// treeCopier.h
+//
+// Contains the class definition for the
+// tree copier, which copies a directory
+// and everything below it as a pipeline:
+// the walker reads the tree and creates
+// each directory as it goes, a pool of
+// workers copies the files many at once,
+// and each directory is given its mode
+// and times once everything in it is done.
+// A batch of items from one directory can
+// be copied the same way, all at once.
+// ---
+
+#ifndef TREE_COPIER_H
+#define TREE_COPIER_H
+#include "progress.h"
+#include "walker.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+class TreeCopier : public WalkVisitor
+{
+	private:
+		//A directory that has been created, which is finished once it
+		//has been walked and everything in it has been copied:
+		struct Target
+		{
+			Target* parent;
+			std::string path;
+			struct stat attr;
+			std::atomic <unsigned int> pending;
+		};
+
+		//An item waiting to be copied into a target, and where it is
+		//copied from, relative to the directory open as the fd:
+		struct Task
+		{
+			Target* target;
+			int fd;
+			std::string from;
+			std::string name;
+			struct stat attr;
+		};
+
+		//Counts the items and bytes copied, may be NULL:
+		Progress* _progress;
+
+		//The paths being copied from and to, each ending in a '/':
+		std::string _from;
+		std::string _to;
+
+		//Every target created, deleted once the copy is over:
+		std::vector <Target*> _targets;
+
+		//The directory a batch is copied into, which is there already,
+		//so is never given a mode or times, or NULL:
+		Target* _base;
+
+		//The paths of the items made at the top of the copy, which are
+		//deleted if it is cancelled:
+		std::vector <std::string> _made;
+
+		//The items waiting to be copied, the number being copied, and
+		//the number of workers waiting for more:
+		std::deque <Task> _queue;
+		unsigned int _running;
+		unsigned int _idle;
+
+		//Cleared once a clone fails, as it will fail for every file
+		//between the same two filesystems:
+		std::atomic <bool> _cloning;
+
+		//The workers, which copy the items:
+		std::vector <std::thread> _workers;
+
+		//Guards everything above, wakes idle workers, and wakes the
+		//walker once there is room in the queue or the copy is over:
+		std::mutex _lock;
+		std::condition_variable _wake;
+		std::condition_variable _room;
+		bool _stopping;
+
+		//Set once anything fails, which stops the walk, and the error:
+		std::atomic <bool> _failed;
+		int _error;
+
+		//The main loop for each of the workers:
+		void work();
+
+		//Sets the paths being copied from and to:
+		void setPaths(const std::string&, const std::string&);
+
+		//Queues an item to be copied, waiting if too many already are:
+		void queue(Task&);
+
+		//Waits for everything queued to be copied, then tidies up,
+		//returning false with errno set if anything failed:
+		bool finish();
+
+		//Copies a single item, returns false with errno set on failure:
+		bool copyItem(const Task&);
+
+		//Notes an item made at the top of the copy:
+		void made(const Task&, const std::string&);
+
+		//Marks one of the target's pending tasks as done, giving it,
+		//and its parents as they finish, their mode and times:
+		void release(Target*);
+
+		//Records the first error, and stops the copy:
+		void fail(int);
+
+	public:
+		//The most items waiting to be copied before the walk waits:
+		static const unsigned int QUEUE_LIMIT = 4096;
+
+		//Default constructor, takes the number of workers, and the
+		//progress to count what is copied in, which may be NULL:
+		TreeCopier(unsigned int, Progress* = NULL);
+
+		//Destructor, stops and joins the workers:
+		~TreeCopier();
+
+		//Copies the directory at the first path to the second, which
+		//should not exist yet. Returns false with errno set if anything
+		//could not be copied. If it was cancelled, what had been copied
+		//is deleted:
+		bool copy(const std::string&, const std::string&);
+
+		//Copies the named items in the directory open as the fd, whose
+		//path is given, into the directory at the second path. None of
+		//the items should be there yet. Directories are copied as above,
+		//and the rest all at once, reading them through the fd:
+		bool copy(int, const std::string&, const std::vector <std::string>&, const std::string&);
+
+		//Called by the walker:
+		void entered(WalkNode*);
+		void file(WalkNode*, const char*, const struct stat&);
+		void finished(WalkNode*);
+		void failed(WalkNode*, int);
+};
+
+#endif
@@ -0,0 +1,144 @@
+// --- treeDeleter.cpp
+#include "treeDeleter.h"
+#include "stats.h"
+#include <cerrno>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+TreeDeleter::TreeDeleter(Progress* progress)
+{
+	_progress = progress;
+	_failed = false;
+	_error = 0;
+	_missed = false;
+	_parent = -1;
+}
+
+//Opens the directory the tree is in, so the tree is only ever looked up
+//by its name in it:
+bool TreeDeleter::remove(const std::string& path)
+{
+	std::string dir = path;
+	while((dir.size() > 1) && (dir[dir.size() - 1] == '/'))
+		dir.erase(dir.size() - 1);
+
+	size_t slash = dir.rfind('/');
+	std::string name = ((slash == std::string::npos) ? dir : dir.substr(slash + 1));
+	std::string parent = ((slash == std::string::npos) ? "." : dir.substr(0, (slash + 1)));
+
+	int fd = open(parent.c_str(), (O_PATH | O_DIRECTORY | O_CLOEXEC));
+	if(fd < 0)
+		return false;
+
+	bool removed = remove(fd, name, path);
+	int error = errno;
+	close(fd);
+	errno = error;
+	return removed;
+}
+
+//Walks the tree, deleting it as it goes. A directory is only read
+//once, so anything added to it while it is, or that the filesystem
+//skips as it changes underneath, is picked up by another walk. The
+//tree is opened without following links on each walk, so one swapped
+//in for it is never followed:
+bool TreeDeleter::remove(int parent, const std::string& name, const std::string& path)
+{
+	Stats::Span span(Stats::DELETE);
+
+	_parent = parent;
+	_name = name;
+	Walker walker(Walker::getThreads());
+	for(unsigned int pass = 0; pass < PASSES; pass++)
+	{
+		_missed = false;
+		try
+		{
+			Stats::count(Stats::SYSCALLS);
+			int fd = openat(parent, name.c_str(), (O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+			if(fd < 0)
+				throw errno;
+			walker.walk(fd, path, this, &_failed);
+		}
+		catch(int e)
+		{
+			//Whatever was missed has since gone:
+			if((e == ENOENT) && (pass > 0))
+				return true;
+			fail(e);
+		}
+
+		if(_failed)
+		{
+			errno = _error;
+			return false;
+		}
+		if(! _missed)
+			return true;
+	}
+
+	errno = ENOTEMPTY;
+	return false;
+}
+
+//Unlinks an item from the directory being read:
+void TreeDeleter::file(WalkNode* node, const char* name, const struct stat& attr)
+{
+	//The walk waits here while the delete is paused:
+	if((_progress != NULL) && (! _progress->check()))
+	{
+		fail(errno);
+		return;
+	}
+
+	Stats::count(Stats::SYSCALLS);
+	if(unlinkat(node->fd, name, 0) == 0)
+	{
+		Stats::count(Stats::DELETED);
+		if(_progress != NULL)
+			_progress->items++;
+	}
+	else if(errno != ENOENT)
+		fail(errno);
+}
+
+//Removes a directory once everything in it has been, from its parent,
+//which is still open, so nothing on the way to it is looked up again:
+void TreeDeleter::finished(WalkNode* node)
+{
+	int result = 0;
+	Stats::count(Stats::SYSCALLS);
+	if(node->parent == NULL)
+		result = unlinkat(_parent, _name.c_str(), AT_REMOVEDIR);
+	else
+	{
+		std::string name = node->path.substr(node->name, (node->path.size() - node->name - 1));
+		result = unlinkat(node->parent->fd, name.c_str(), AT_REMOVEDIR);
+	}
+
+	if(result == 0)
+	{
+		Stats::count(Stats::DELETED);
+		if(_progress != NULL)
+			_progress->items++;
+	}
+	else if((errno == ENOTEMPTY) || (errno == EEXIST))
+		_missed = true;
+	else if(errno != ENOENT)
+		fail(errno);
+}
+
+//A directory which cannot be read cannot be emptied:
+void TreeDeleter::failed(WalkNode* node, int error)
+{
+	fail(error);
+}
+
+//Keeps the first error, which stops the walk:
+void TreeDeleter::fail(int error)
+{
+	bool failed = false;
+	if(_failed.compare_exchange_strong(failed, true))
+		_error = error;
+}
@@ -0,0 +1,71 @@
+// ---
+// treeDeleter.h
+//
+// Contains the class definition for the
+// tree deleter, which deletes a directory
+// and everything below it on a walker of
+// its own, spreading the subdirectories
+// across its threads. Items are unlinked
+// relative to the open directory they are
+// read from, and directories relative to
+// their parent's, which is kept open until
+// they are gone, the tree itself included. Only the type the
+// directory gives is used, so nothing
+// is stat'ed.
+// ---
+
+#ifndef TREE_DELETER_H
+#define TREE_DELETER_H
+#include "progress.h"
+#include "walker.h"
+#include <atomic>
+#include <string>
+#include <sys/stat.h>
+
+class TreeDeleter : public WalkVisitor
+{
+	private:
+		//Counts each item deleted, may be NULL:
+		Progress* _progress;
+
+		//Set once anything fails, which stops the walk, and the error:
+		std::atomic <bool> _failed;
+		std::atomic <int> _error;
+
+		//Set if a directory was not empty after being walked, as its
+		//items were added, or missed, while it was read:
+		std::atomic <bool> _missed;
+
+		//The open directory the tree being deleted is in, and its name:
+		int _parent;
+		std::string _name;
+
+		//Records the first error, and stops the walk:
+		void fail(int);
+
+	public:
+		//The most times a tree is walked if items keep being missed:
+		static const unsigned int PASSES = 3;
+
+		//Default constructor, takes the progress to count the
+		//items deleted in, which may be NULL:
+		TreeDeleter(Progress*);
+
+		//Deletes the directory at the path and everything in it.
+		//Returns false with errno set if anything could not be:
+		bool remove(const std::string&);
+
+		//Deletes the directory with the given name in the directory
+		//open as the fd, whose path is given, the same way. Fails if
+		//it is not a directory, even if it is a link to one:
+		bool remove(int, const std::string&, const std::string&);
+
+		//Called by the walker:
+		bool needsAttributes() { return false; }
+		bool needsParents() { return true; }
+		void file(WalkNode*, const char*, const struct stat&);
+		void finished(WalkNode*);
+		void failed(WalkNode*, int);
+};
+
+#endif
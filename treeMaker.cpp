@@ -0,0 +1,212 @@
+// --- treeMaker.cpp
+#include "treeMaker.h"
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//The names of the shapes, in the order they are listed:
+static const char* NAMES[] = { "wide", "deep", "small", "huge", "sparse" };
+
+//The beginnings of the names made up, mixing case, dotfiles and
+//numbers so the names sort like real ones:
+static const char* STEMS[] = { "file", "Photo_", ".config", "Report-", "track ", "IMG" };
+
+//The size of the buffer files are filled from, and of each block
+//written to a sparse file:
+static const size_t BUFFER_SIZE = (1 << 20);
+static const size_t BLOCK_SIZE = 4096;
+
+//The number of blocks written to each sparse file:
+static const unsigned int SPARSE_BLOCKS = 16;
+
+//Moves the seed on, and returns the next number from it:
+static unsigned int next(unsigned int& seed)
+{
+	seed = (seed * 1103515245) + 12345;
+	return (seed >> 8);
+}
+
+//Returns a made up name for the numbered item:
+static std::string makeName(unsigned int number, unsigned int& seed)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%s%u%c", STEMS[next(seed) % 6], number, (char)('a' + (next(seed) % 26)));
+	return name;
+}
+
+//Returns the name of the shape:
+const char* TreeMaker::getName(Shape shape)
+{
+	return NAMES[shape];
+}
+
+//Finds the shape with the given name:
+bool TreeMaker::parse(const std::string& name, Shape& shape)
+{
+	for(unsigned int i = 0; i < SHAPES; i++)
+	{
+		if(name == NAMES[i])
+		{
+			shape = (Shape)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//Makes a tree of the given shape:
+bool TreeMaker::make(Shape shape, const std::string& path, unsigned int scale)
+{
+	if(scale == 0)
+		scale = 1;
+
+	if(mkdir(path.c_str(), 0755) != 0)
+		return false;
+	int fd = open(path.c_str(), (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if(fd < 0)
+		return false;
+
+	//Each shape starts from its own seed, so it is always made the same:
+	unsigned int seed = (shape + 1);
+	bool made = true;
+	switch(shape)
+	{
+		//Twenty thousand small files, and a hundred directories with a
+		//couple of files in each:
+		case WIDE:
+			for(unsigned int i = 0; (made) && (i < (20000 * scale)); i++)
+				made = makeFile(fd, makeName(i, seed), (next(seed) % 512), seed);
+			for(unsigned int i = 0; (made) && (i < (100 * scale)); i++)
+			{
+				int sub = makeDirectory(fd, ("dir" + std::to_string(i)));
+				made = ((sub >= 0) && (makeFile(sub, "a", 64, seed)) && (makeFile(sub, "b", 64, seed)));
+				if(sub >= 0)
+					close(sub);
+			}
+			break;
+
+		//A chain of 256 directories, each with a few files:
+		case DEEP:
+		{
+			int level = dup(fd);
+			for(unsigned int i = 0; (made) && (level >= 0) && (i < 256); i++)
+			{
+				for(unsigned int j = 0; (made) && (j < (4 * scale)); j++)
+					made = makeFile(level, makeName(j, seed), 1024, seed);
+
+				int sub = makeDirectory(level, "d");
+				close(level);
+				level = sub;
+			}
+			if(level < 0)
+				made = false;
+			else
+				close(level);
+			break;
+		}
+
+		//A hundred directories of a hundred files, each up to 8kB:
+		case SMALL:
+			for(unsigned int i = 0; (made) && (i < (100 * scale)); i++)
+			{
+				int sub = makeDirectory(fd, makeName(i, seed));
+				made = (sub >= 0);
+				for(unsigned int j = 0; (made) && (j < 100); j++)
+					made = makeFile(sub, makeName(j, seed), (next(seed) % 8192), seed);
+				if(sub >= 0)
+					close(sub);
+			}
+			break;
+
+		//Four files of 32MB:
+		case HUGE:
+			for(unsigned int i = 0; (made) && (i < 4); i++)
+				made = makeFile(fd, makeName(i, seed), ((32ULL << 20) * scale), seed);
+			break;
+
+		//Four files of 1GB, with only a few blocks of each written:
+		case SPARSE:
+			for(unsigned int i = 0; (made) && (i < 4); i++)
+				made = makeSparse(fd, makeName(i, seed), ((1ULL << 30) * scale), seed);
+			break;
+	}
+
+	int error = errno;
+	close(fd);
+	errno = error;
+	return made;
+}
+
+//Makes a file full of made up bytes:
+bool TreeMaker::makeFile(int dir, const std::string& name, unsigned long long size, unsigned int& seed)
+{
+	int fd = openat(dir, name.c_str(), (O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC), 0644);
+	if(fd < 0)
+		return false;
+
+	//The buffer is only filled once, with each file starting from a
+	//different place in it:
+	static std::vector <char> buffer;
+	if(buffer.empty())
+	{
+		unsigned int fill = 1;
+		buffer.resize(BUFFER_SIZE);
+		for(size_t i = 0; i < buffer.size(); i++)
+			buffer[i] = (char)next(fill);
+	}
+
+	size_t start = (next(seed) % BUFFER_SIZE);
+	while(size > 0)
+	{
+		size_t length = std::min((unsigned long long)(BUFFER_SIZE - start), size);
+		ssize_t written = write(fd, &buffer[start], length);
+		if(written <= 0)
+		{
+			int error = errno;
+			close(fd);
+			errno = error;
+			return false;
+		}
+		size -= written;
+		start = 0;
+	}
+
+	return (close(fd) == 0);
+}
+
+//Makes a file which is mostly holes:
+bool TreeMaker::makeSparse(int dir, const std::string& name, unsigned long long size, unsigned int& seed)
+{
+	int fd = openat(dir, name.c_str(), (O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC), 0644);
+	if(fd < 0)
+		return false;
+
+	bool made = (ftruncate(fd, size) == 0);
+	std::vector <char> block(BLOCK_SIZE);
+	for(unsigned int i = 0; (made) && (i < SPARSE_BLOCKS); i++)
+	{
+		for(size_t j = 0; j < block.size(); j++)
+			block[j] = (char)next(seed);
+
+		off_t offset = ((size / SPARSE_BLOCKS) * i) & ~((off_t)BLOCK_SIZE - 1);
+		made = (pwrite(fd, &block[0], block.size(), offset) == (ssize_t)block.size());
+	}
+
+	int error = errno;
+	if((close(fd) != 0) && (made))
+		return false;
+	errno = error;
+	return made;
+}
+
+//Makes a directory, and opens it:
+int TreeMaker::makeDirectory(int dir, const std::string& name)
+{
+	if(mkdirat(dir, name.c_str(), 0755) != 0)
+		return -1;
+	return openat(dir, name.c_str(), (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+}
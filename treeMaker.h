@@ -0,0 +1,52 @@
+// ---
+// treeMaker.h
+//
+// Contains the class definition for the
+// tree maker, which builds made up trees
+// of files and directories for the bench
+// to measure. The same shape and scale
+// always gives the same names, sizes and
+// contents, so runs can be compared.
+// ---
+
+#ifndef TREEMAKER_H
+#define TREEMAKER_H
+#include <string>
+
+class TreeMaker
+{
+	public:
+		//The shapes of tree that can be made: one directory with a great
+		//many files, a long chain of directories with a few files in each,
+		//many directories of small files, a few huge files, and a few huge
+		//files which are mostly holes:
+		enum Shape { WIDE, DEEP, SMALL, HUGE, SPARSE };
+		static const unsigned int SHAPES = 5;
+
+		//Returns the name of the shape, as used on the command line:
+		static const char* getName(Shape);
+
+		//Sets the shape with the given name, returns false if there is
+		//not one:
+		static bool parse(const std::string&, Shape&);
+
+		//Makes a tree of the shape given at the path, which must not
+		//exist yet, with the numbers of items, or the sizes of the huge
+		//files, multiplied by the scale. Returns false, with errno set,
+		//if it could not be made:
+		static bool make(Shape, const std::string&, unsigned int = 1);
+
+	private:
+		//Makes a file of the given size in the directory, filled with
+		//bytes from the seed, which is moved on:
+		static bool makeFile(int, const std::string&, unsigned long long, unsigned int&);
+
+		//Makes a file of the given size in the directory with only a
+		//few blocks written, the rest left as holes:
+		static bool makeSparse(int, const std::string&, unsigned long long, unsigned int&);
+
+		//Makes a directory in the one given, returning it opened, or -1:
+		static int makeDirectory(int, const std::string&);
+};
+
+#endif
@@ -1,7 +1,18 @@
 // --- trilobite.cpp
+#include "batch.h"
 #include "diskItem.h"
 #include "directory.h"
-#include "file.h"
+#include "filter.h"
+#include "headless.h"
+#include "jobs.h"
+#include "listing.h"
+#include "listingCache.h"
+#include "notifier.h"
+#include "prefetcher.h"
+#include "sizer.h"
+#include "stats.h"
+#include "walker.h"
+#include "watcher.h"
 
 #include <ncurses.h> 
 #include <iostream>
@@ -10,35 +21,109 @@
 #include <algorithm>
 #include <cerrno>
 #include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
+#include <thread>
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
 
 const short COLOUR = COLOR_BLUE; 
 
-//Prints the given DiskItem's metadata to the fileinfo window:
-void printMetaData(DiskItem*);
+//Prints the name and size of the item with the given id to the given row of the fileview window:
+void printItem(unsigned int, Listing&, unsigned int, bool);
+
+//Prints the rows the filter shows of the listing that fit in the fileview window,
+//from the given row, and adds the ids of those still being sized to the vector
+//passed:
+void printItems(Listing&, Filter&, unsigned int, unsigned int, std::vector <unsigned int>&);
+
+//Returns how many rows the key given moves the selection, with the given
+//number of rows on screen, or 0 if it does not move it:
+int getMove(int, unsigned int);
+
+//Prints the metadata of the item with the given id to the fileinfo window:
+void printMetaData(Listing&, unsigned int);
 
 //Prints the passed clipboard's data:
-void printClipboard(DiskItem*);
+void printClipboard(Batch*);
+
+//Prints what the background jobs are doing under the clipboard:
+void printJobs(Batch*, const std::vector <Jobs::Status>&);
+
+//Prints how long the last frame took to draw, and how fast items are
+//being read, system calls made and bytes copied, in place of the clipboard:
+void printStats();
+
+//Returns a count in a few characters, such as '12k':
+std::string formatCount(unsigned long long);
 
-//Redraws all the windows:
-void updateWindows();
+//Creates the windows to fit the screen, replacing any already there:
+void createWindows();
+
+//Draws the border of the fileview window, the directory path and the help text:
+void drawFrame(const std::string&);
 
 //Draws the help text:
 void drawHelp();
 
+//Draws the filter in place of the help text, with a cursor after it
+//while it is being typed:
+void drawFilter(Filter&, bool);
+
+//Draws the prefix being jumped to in place of the help text:
+void drawJump(const std::string&);
+
 //Creates a message box with the passed error:
 void messageBox(std::string);
 
+//Shows every job running or waiting, and those just finished, with
+//how far each has got, letting the user pause or cancel them:
+void jobsBox(Jobs&);
+
+//Returns how far a job has got, in a few characters:
+std::string formatProgress(const Jobs::Status&);
+
+//Returns the number of seconds given in hours, minutes and seconds:
+std::string formatTime(long long);
+
 //Creates an input box, allowing the user to enter
 //text, which is returned:
 std::string inputBox();
 
-//Takes a directory path, and returns it shrunk to fit the size:
-std::string fitToSize(std::string path, unsigned int size);
-
 //Checks if the given character is allowed in a filename:
 bool isValidInput(char c);
 
+//Queues the sizes of the directory's subdirectories to be calculated:
+void requestSizes(Directory*, Sizer&, unsigned int = 0);
+
+//Queues the sizes of all the subdirectories in the directory's listing,
+//even those already sized:
+void refreshSizes(Directory*, Sizer&);
+
+//Gives an item in the listing the size calculated for it, returns true
+//if it has been fully sized:
+bool applySize(Listing&, const Sizer::Result&);
+
+//Makes a batch of the marked items in the directory, unmarking them, or
+//if none are marked, of the item with the given id. Returns NULL if there
+//is nothing to put in it, or the directory cannot be opened:
+Batch* takeBatch(Directory*, unsigned int);
+
+//Returns the names of the items in the batch:
+std::vector <std::string> getNames(Batch*);
+
+//Returns the name of the only item in the batch, or how many there are:
+std::string describeBatch(Batch*);
+
+//Queues the sizes of the clipboard's items which are not sized yet, or
+//stops them being calculated:
+void requestClipboard(Batch*, Sizer&);
+void forgetClipboard(Batch*, Sizer&);
+
 //The various windows used by the program:
 struct windows
 {
@@ -47,16 +132,68 @@ struct windows
 } fileview, fileinfo, extrainfo, messagebox, inputbox;
 
 //The help text at the bottom:
-const std::string HELP_TEXT = " X: Cut C: Copy P: Paste R: Rename D: Delete Q: Quit";
+const std::string HELP_TEXT = " X: Cut C: Copy P: Paste R: Rename D: Delete M: Mark N: Natural W: Jobs Q: Quit";
 
 //The height and width of the window:
 unsigned int screenX = 0, screenY = 0;
 
+//The ids the clipboard's items are sized under, counting down from the
+//first, which no item in a listing has, and the most items sized:
+const unsigned int CLIPBOARD = (Sizer::NONE - 1);
+const unsigned int CLIPBOARD_ITEMS = (1 << 20);
+
 int main(int argc, char* argv[])
 {
 	//The current working directory:
 	Directory* dir = NULL;
 
+	//Takes out the options, leaving the directory, if one is given:
+	std::string trace;
+	std::string operation;
+	bool json = false;
+	size_t cacheBudget = ListingCache::DEFAULT_BUDGET;
+	std::vector <char*> args(1, argv[0]);
+	for(int i = 1; i < argc; i++)
+	{
+		if((std::string(argv[i]) == "--trace") && ((i + 1) < argc))
+			trace = argv[++i];
+		else if((std::string(argv[i]) == "--jobs") && ((i + 1) < argc))
+		{
+			int jobs = atoi(argv[++i]);
+			if(jobs < 1)
+			{
+				std::cerr << "Please pass a number of jobs above 0\n";
+				return -1;
+			}
+			Walker::setThreads(jobs);
+		}
+		else if((std::string(argv[i]) == "--cache") && ((i + 1) < argc))
+			cacheBudget = ((size_t)strtoul(argv[++i], NULL, 10) << 20);
+		else if(std::string(argv[i]) == "--json")
+			json = true;
+		else if((operation == "") && (Headless::isOperation(argv[i])))
+			operation = argv[i];
+		else
+			args.push_back(argv[i]);
+	}
+	argc = args.size();
+	argv = &args[0];
+
+	//Runs the operation given without the interface, printing the results:
+	if(operation != "")
+	{
+		if((trace != "") && (! Stats::trace(trace)))
+		{
+			std::cerr << "Cannot write '" << trace << "': " << strerror(errno) << std::endl;
+			return -1;
+		}
+
+		Headless headless(json);
+		int status = headless.run(operation, std::vector <std::string>((argv + 1), (argv + argc)));
+		Stats::finish();
+		return status;
+	}
+
 	//Checks if too many arguments have been given:
 	if(argc > 2)
 	{
@@ -112,13 +249,13 @@ int main(int argc, char* argv[])
 			return -1;
 		}
 	}
-	//Attempt to read the directory's contents:
-	try
-	{
-		dir->read();
-	}
+	//Check the directory's contents can be read before starting, as they
+	//are read in the background once the screen is up:
+	int probe = open(dir->getPath().c_str(), (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if(probe >= 0)
+		close(probe);
 	//Give an error message and quit if it fails:
-	catch(int e)
+	else
 	{
 		std::cerr << "Cannot open '" << dir->getPath() << "': ";
 		switch(errno)
@@ -134,14 +271,26 @@ int main(int argc, char* argv[])
 	if(dir->getName() == "../")
 		dir->cleanPath();
 
+	//Starts writing what takes the time to the trace file, if asked to:
+	if((trace != "") && (! Stats::trace(trace)))
+	{
+		std::cerr << "Cannot write '" << trace << "': " << strerror(errno) << std::endl;
+		return -1;
+	}
+
 	//Initialise ncurses:
 	initscr();
 
 	//The colour pairs:
 	init_pair(2, COLOR_WHITE, COLOR_RED);
+	init_pair(3, COLOR_YELLOW, COLOR_BLACK);
 	//Enable keypad mode (allows use of the up and down arrows):
 	keypad(stdscr, true);
 
+	//Escape is told apart from the keys which start with it quickly, as it
+	//takes the filter away:
+	set_escdelay(25);
+
 	//Start using colour:
 	start_color();
 
@@ -152,147 +301,493 @@ int main(int argc, char* argv[])
 	curs_set(0);
 	noecho();
 
+	//SIGWINCH is only let through while waiting for events, so a resize
+	//cannot slip in just before the wait and be missed. The threads started
+	//from here on never see it:
+	sigset_t resize, waiting;
+	sigemptyset(&resize);
+	sigaddset(&resize, SIGWINCH);
+	pthread_sigmask(SIG_BLOCK, &resize, &waiting);
+
 	int input = 0;
-	std::string path = "";
 	unsigned int selection = 0;
-	DiskItem* clipboard = NULL;
+	Batch* clipboard = NULL;
 
-	//While the user has not quit:
-	while((char(input) != 'q') && (char(input) != 'Q'))
-	{
-		//Redraw the windows and help:
-		updateWindows();
-		drawHelp();
+	//True if the stats are shown in place of the clipboard:
+	bool showStats = false;
 
-		//If necessary, resizes the directory path:
-		path = "";
-		if(dir->getPath().length() >= screenX)
-			path = fitToSize(dir->getPath(), (screenX - 2));
-		else
-			path = dir->getPath();
+	//The first row shown, and what was on screen when it was last drawn,
+	//so moving the selection only has to redraw the two rows it changes:
+	unsigned int top = 0;
+	unsigned int drawnTop = 0, drawnSelection = 0;
+	bool redraw = true;
 
-		//The X position needed to print the path in the centre:
-		int pos = ((screenX - path.length()) / 2);
-		//Write the user's current directory:
-		mvprintw(0, pos, "%s", path.c_str());
+	//Woken by the background threads whenever they have finished something:
+	Notifier notifier;
 
-		//Get the files and sort the contents:
-		std::vector <DiskItem*> items = dir->getFiles();
+	//Calculates directory sizes in the background:
+	Sizer sizer(Walker::getThreads(), &notifier);
 
-		//Checks if the contents of the directory will fit in the window:
-		if((fileview.height - 2) > (items.size() - dir->getDotfiles()))
-		{
-			//Print the contents, except the dotfiles, to the window:
-			for(unsigned int i = dir->getDotfiles(); i < items.size(); i++)
+	//Runs reads, pastes and deletes in the background, and the directory
+	//being opened, if there is one:
+	Jobs jobs(&notifier);
+	Directory* loading = NULL;
+	unsigned int loadingJob = 0;
+
+	//Keeps the listing up to date with changes made elsewhere:
+	Watcher watcher;
+
+	//Keeps the directories left, so going back to one shows it straight away:
+	ListingCache cache(cacheBudget);
+
+	//The rows of the listing shown, and whether a filter is being typed:
+	Filter filter;
+	bool filtering = false;
+
+	//The start of a name being typed to jump to, while it is:
+	std::string jump;
+	bool jumping = false;
+
+	//Reads the directories around the selection while it rests on them, to
+	//be opened from the cache, and the id of the item it last rested on:
+	Prefetcher prefetcher(&notifier);
+	unsigned int prefetched = Sizer::NONE;
+
+	//Moves to the directory given, keeping the one shown in the cache with
+	//the item selected in it and the first row shown:
+	auto moveTo = [&](Directory* next)
+	{
+		//Stop sizing and reading ahead the old directory's contents before
+		//putting them away:
+		sizer.cancel();
+		prefetcher.cancel();
+		prefetched = Sizer::NONE;
+		if(dir != NULL)
+			cache.put(dir, filter.getId(selection), top);
+		dir = next;
+		selection = 0;
+		filter.show(&dir->getListing());
+		filtering = false;
+		jumping = false;
+
+		requestClipboard(clipboard, sizer);
+		watcher.watch(dir);
+	};
+
+	//Merges the runs of the directory being opened read so far, moving to
+	//it with its first run, so a huge directory is shown straight away and
+	//filled in as the rest is read. Returns true if anything was merged:
+	auto mergeLoading = [&]()
+	{
+		unsigned int first = 0;
+		if((loading == NULL) || (! loading->merge(first)))
+			return false;
+
+		if(dir != loading)
+			moveTo(loading);
+		requestSizes(dir, sizer, first);
+		return true;
+	};
+
+	//Reads the directory given in the background, a run at a time:
+	auto startLoading = [&](Directory* next)
+	{
+		loading = next;
+		loadingJob = jobs.start(("Opening '" + next->getPath() + "'"),
+			[next, &notifier](Progress& progress)
 			{
-				//If we're printing the current selection, highlight it:
-				if(selection == (i - dir->getDotfiles()))
+				try
 				{
-					//Print the name:
-					mvwprintw(fileview.window,((i - dir->getDotfiles()) + 1), 1, "%s", items[i]->getName().c_str());
+					next->stream([&notifier]() { notifier.notify(); }, &progress);
+				}
+				catch(int e)
+				{
+					return e;
+				}
+				return 0;
+			},
+			[&, next](int error)
+			{
+				mergeLoading();
+				loading = NULL;
 
-					//Move to the beginning of the line, and highlight the line up to but excluding the window border:
-					mvwchgat(fileview.window, ((i - dir->getDotfiles()) + 1), 1, (fileview.width - 2), A_NORMAL, 1, NULL);
+				//If an error occurs, inform the user with a message box, unless
+				//the read was cancelled:
+				if(error != 0)
+				{
+					std::string message = "Cannot open '" + next->getPath() + "' ";
+					switch(error)
+					{
+						case EACCES:  message += "Permission denied."; break;
+						case ENOENT:  message += "No such directory."; break;
+						case ENOTDIR: message += "Not a directory."; break;
+					}
+
+					//Only a directory never shown is thrown away, one shown
+					//keeps what was read of it:
+					if(next != dir)
+						delete next;
+					if(error != ECANCELED)
+						messageBox(message);
 				}
-				else
-					//Print the name:
-					mvwprintw(fileview.window, ((i - dir->getDotfiles()) + 1), 1, "%s", items[i]->getName().c_str());
+			});
+	};
+
+	//The windows are only created again when the terminal is resized:
+	createWindows();
+
+	//Starts reading the directory, and waits for its first run, so there is
+	//something to show:
+	Directory* opening = dir;
+	dir = NULL;
+	startLoading(opening);
+	while(dir == NULL)
+	{
+		mergeLoading();
+		if((jobs.collect()) && (dir == NULL))
+		{
+			endwin();
+			Stats::finish();
+			return -1;
+		}
+
+		struct pollfd event = { notifier.getFd(), POLLIN, 0 };
+		struct timespec tick = { 0, 100000000 };
+		if(dir == NULL)
+			ppoll(&event, 1, ((event.fd < 0) ? &tick : NULL), &waiting);
+		notifier.clear();
+	}
+
+	//While the user has not quit:
+	while((char(input) != 'q') && (char(input) != 'Q'))
+	{
+		//Get the sorted contents, and the rows shown of them:
+		Listing& items = dir->getListing();
+		filter.update();
+		unsigned int count = filter.size();
+		unsigned int rows = (fileview.height > 2) ? (fileview.height - 2) : 0;
+
+		//Scrolls just far enough to keep the selection in the window,
+		//without leaving empty rows at the bottom:
+		if(selection < top)
+			top = selection;
+		else if((rows > 0) && (selection >= (top + rows)))
+			top = (selection + 1) - rows;
+		if((top + rows) > count)
+			top = (count > rows) ? (count - rows) : 0;
+
+		//Remembers the selected item, so it stays selected if
+		//the listing changes underneath it:
+		unsigned int current = filter.getId(selection);
+
+		//Once the selection has moved, reads ahead the directory selected, then
+		//those either side of it, unless they are already in the cache. None
+		//is read ahead from a directory still being read:
+		if((current != prefetched) && (dir != loading))
+		{
+			std::vector <std::string> paths;
+			unsigned int around[3] = { selection, (selection + 1), (selection - 1) };
+			for(unsigned int i = 0; i < 3; i++)
+			{
+				if(around[i] >= count)
+					continue;
+
+				unsigned int id = filter.getId(around[i]);
+				if((items.isDirectory(id)) && (! cache.has(dir->getItemPath(id))))
+					paths.push_back(dir->getItemPath(id));
 			}
+			prefetcher.request(paths);
+			prefetched = current;
 		}
-		//Otherwise, we can only print part of the directory's contents:
+
+		//Draws every row if the listing or the window has changed, or
+		//it has scrolled, otherwise only the rows the selection moved
+		//between. Either way, only rows on screen are touched. The time
+		//each frame takes is kept in the stats:
+		int64_t frame = Stats::now();
+		if((redraw) || (top != drawnTop))
+		{
+			drawFrame(dir->getPath());
+			if(jumping)
+				drawJump(jump);
+			else if((filtering) || (filter.isActive()))
+				drawFilter(filter, filtering);
+
+			std::vector <unsigned int> visible;
+			printItems(items, filter, top, selection, visible);
+
+			//Size what is on screen first:
+			sizer.prioritise(visible);
+		}
+		else if(selection != drawnSelection)
+		{
+			printItem(((drawnSelection - top) + 1), items, filter.getId(drawnSelection), false);
+			printItem(((selection - top) + 1), items, current, true);
+		}
+		redraw = false;
+		drawnTop = top;
+		drawnSelection = selection;
+
+		//Size the selection before anything else:
+		sizer.prioritise(std::vector <unsigned int>(1, current));
+
+		//Print the selected file's metadata to the 'fileinfo' window, and how many
+		//items are marked at the bottom:
+		werase(fileinfo.window);
+		wborder(fileinfo.window, '|', '|', '-', '-', '+', '+', '+', '+');
+		printMetaData(items, current);
+		if((items.getMarked() > 0) && (fileinfo.height > 6))
+			mvwprintw(fileinfo.window, (fileinfo.height - 2), 1, "%u marked", items.getMarked());
+
+		//Print the contents of the clipboard, and the jobs running, or the stats
+		//if they are shown, to the 'extrainfo' window:
+		werase(extrainfo.window);
+		wborder(extrainfo.window, '|', '|', '-', '-', '+', '+', '+', '+');
+		if(showStats)
+			printStats();
 		else
 		{
-			//If the selection is less than the height, display the first few items:
-			if(selection < (fileview.height - 2))
-			{
-				for(unsigned int i = dir->getDotfiles(); i < ((fileview.height - 2) + dir->getDotfiles()); i++)
-				{
-					//If we're printing the current selection, highlight it:
-					if(selection == (i - dir->getDotfiles()))
-					{
-						//Print the name:
-						mvwprintw(fileview.window,((i - dir->getDotfiles()) + 1), 1, "%s", items[i]->getName().c_str());
+			printClipboard(clipboard);
+			printJobs(clipboard, jobs.getRunning());
+		}
 
-						//Move to the beginning of the line, and highlight the line up to but excluding the window border:
-						mvwchgat(fileview.window, ((i - dir->getDotfiles()) + 1), 1, (fileview.width - 2), A_NORMAL, 1, NULL);
-					}
-					else
-						//Print the name:
-						mvwprintw(fileview.window, ((i - dir->getDotfiles()) + 1), 1, "%s", items[i]->getName().c_str());
-				}
+		//Sends what has changed to the screen in one go:
+		wnoutrefresh(stdscr);
+		wnoutrefresh(fileview.window);
+		wnoutrefresh(fileinfo.window);
+		wnoutrefresh(extrainfo.window);
+		doupdate();
+		Stats::add(Stats::FRAME, frame, Stats::now());
+		Stats::sample();
+
+		//Sleeps until there is a key, a size or job has finished, or something
+		//being watched has changed. The key is read first, as ncurses may have
+		//already read it from the terminal:
+		Directory* shown = dir;
+		bool changed = false;
+		timeout(0);
+		while(true)
+		{
+			//The directory being opened may have more runs read, or a
+			//finished job may have opened another directory:
+			if(mergeLoading())
+				changed = true;
+			if(jobs.collect())
+				changed = true;
+			if(dir != shown)
+				break;
+
+			input = getch();
+
+			//Keeps the directories read ahead, unless they have been opened
+			//in the meantime:
+			std::vector <Directory*> read;
+			prefetcher.collect(read);
+			for(unsigned int i = 0; i < read.size(); i++)
+			{
+				Listing& listing = read[i]->getListing();
+				if(cache.has(read[i]->getPath()))
+					delete read[i];
+				else
+					cache.put(read[i], listing.getId(std::min(listing.getDotfiles(), (listing.size() - 1))), 0);
 			}
-			//Otherwise, display the selection as the last item:
-			else
+
+			//Once a directory is sized, changes anywhere inside it are watched:
+			std::vector <Sizer::Result> sizes;
+			if(sizer.collect(sizes))
+				changed = true;
+			for(unsigned int i = 0; i < sizes.size(); i++)
 			{
-				for(unsigned int i = (dir->getDotfiles() + ((selection + 1) - (fileview.height - 2))); i < ((selection + 1) + dir->getDotfiles()); i++)
+				if(sizes[i].id > (CLIPBOARD - CLIPBOARD_ITEMS))
 				{
-					unsigned int y = i - ((selection - (fileview.height - 2)) + dir->getDotfiles());
-
-					//If we're printing the current selection, highlight it:
-					if(selection == (i - dir->getDotfiles()))
-					{
-						//Print the name:
-						mvwprintw(fileview.window, y, 1, "%s", items[i]->getName().c_str());
-
-						//Move to the beginning of the line, and highlight the line up to but excluding the window border:
-						mvwchgat(fileview.window, y, 1, (fileview.width - 2), A_NORMAL, 1, NULL);
-					}
-					else
-						//Print the name:
-						mvwprintw(fileview.window, y, 1, "%s", items[i]->getName().c_str());
+					unsigned int index = CLIPBOARD - sizes[i].id;
+					if((clipboard != NULL) && (index < clipboard->size()) && (! sizes[i].relative))
+						clipboard->setSize(index, ((sizes[i].error == 0) ? sizes[i].size : 0));
 				}
+				else if(applySize(items, sizes[i]))
+					watcher.watchSubtree(sizes[i].id, dir->getItemPath(sizes[i].id));
 			}
+
+			//Changes are only applied once the whole directory has been read,
+			//so none is applied to an item still to be merged:
+			if((dir != loading) && (watcher.update(dir, sizer)))
+				changed = true;
+
+			if((changed) || (input != ERR))
+				break;
+
+			//Waits on the terminal, the notifier and the watcher, or for a
+			//resize, which interrupts the wait. Without a notifier, it has
+			//to check back for sizes and jobs now and then, and while jobs
+			//are running, or the stats are shown, it checks back to show how
+			//far they have got:
+			struct pollfd events[3];
+			events[0].fd = STDIN_FILENO;
+			events[1].fd = notifier.getFd();
+			events[2].fd = (dir != loading) ? watcher.getFd() : -1;
+			for(unsigned int i = 0; i < 3; i++)
+				events[i].events = POLLIN;
+
+			struct timespec tick = { 0, 100000000 };
+			struct timespec progress = { 0, 250000000 };
+			if(notifier.getFd() < 0)
+				ppoll(events, 3, &tick, &waiting);
+			else if((jobs.busy()) || (showStats))
+			{
+				if(ppoll(events, 3, &progress, &waiting) == 0)
+					break;
+			}
+			else
+				ppoll(events, 3, NULL, &waiting);
+			notifier.clear();
 		}
 
-		//Print the selected file's metadata to the 'fileinfo' window:
-		printMetaData(items[selection + dir->getDotfiles()]);
+		//Starts again with the directory which has been opened:
+		if(dir != shown)
+		{
+			redraw = true;
+			continue;
+		}
 
-		//Print the contents of the clipboard to the 'extrainfo' window:
-		printClipboard(clipboard);
+		//Anything but moving the selection may change what is on screen. If
+		//nothing has, only the jobs' progress is drawn again:
+		if(changed)
+			redraw = true;
+		else if((input != ERR) && (getMove(input, rows) == 0))
+			redraw = true;
+
+		//The terminal has been resized, so the windows are made again to fit:
+		if(input == KEY_RESIZE)
+			createWindows();
+
+		//Picks up any changes to the listing, keeping the same item selected:
+		filter.update();
+		unsigned int found = filter.indexOf(current, selection);
+		if(found < filter.size())
+			selection = found;
+		else if(selection >= filter.size())
+			selection = filter.size() - 1;
+
+		//Keys which type a character, rather than only moving the selection:
+		bool typed = ((input >= ' ') && (input < 0x100) && (input != 127));
+		bool moving = ((! typed) && (getMove(input, rows) != 0));
+
+		//While a filter is being typed, keys add to it rather than being
+		//commands, apart from those moving the selection. Enter keeps it,
+		//Escape takes it away, and Tab moves to the next way of matching.
+		//Each change to it selects the first row:
+		if((filtering) && (input != ERR) && (! moving) && (input != KEY_RESIZE))
+		{
+			std::string query = filter.getQuery();
+			Filter::Mode mode = filter.getMode();
+			if(char(input) == '\n')
+				filtering = false;
+			else if(input == 27)
+			{
+				filtering = false;
+				query = "";
+			}
+			else if(char(input) == '\t')
+				mode = (Filter::Mode)((mode + 1) % Filter::MODES);
+			else if((input == KEY_BACKSPACE) || (input == 127) || (input == 8))
+			{
+				if(query != "")
+					query.erase(query.size() - 1);
+			}
+			else if(typed)
+				query += char(input);
 
-		//Refresh the screen and windows:
-		refresh();
-		wrefresh(fileview.window);
-		wrefresh(fileinfo.window);
-		wrefresh(extrainfo.window);
+			if((query != filter.getQuery()) || (mode != filter.getMode()))
+			{
+				filter.set(query, mode);
+				selection = 0;
+				top = 0;
+			}
+			input = 0;
+			redraw = true;
+		}
 
-		//Gets the input:
-		input = getch();
+		//While the start of a name is being typed, each key adds to it and
+		//selects the first row at or after it in the order. Enter or Escape
+		//stop, as does any key moving the selection, which still moves it:
+		if((jumping) && (input != ERR) && (input != KEY_RESIZE))
+		{
+			if((char(input) == '\n') || (input == 27) || (moving))
+				jumping = false;
+			else if((input == KEY_BACKSPACE) || (input == 127) || (input == 8))
+			{
+				if(jump != "")
+					jump.erase(jump.size() - 1);
+			}
+			else if(typed)
+				jump += char(input);
+
+			if((jumping) && (jump != ""))
+				selection = filter.seek(jump);
+			if(! moving)
+				input = 0;
+			redraw = true;
+		}
 
-		//Moves the selection up or down if those keys were pressed:
-		if((input == KEY_UP) || (char(input) == 'k') || (char(input) == 'K'))
-			if(selection > 0) selection--;
-		if((input == KEY_DOWN) || (char(input) == 'j') || (char(input) == 'J'))
-			if(selection < ((items.size() - dir->getDotfiles()) - 1)) selection++;
+		//Moves the selection if one of the keys moving it was pressed, keeping
+		//it in the listing. Paging moves the rows shown by as much, and the
+		//scrolling above then keeps the selection in the window:
+		int move = getMove(input, rows);
+		if((move != 0) && (filter.size() > 0))
+		{
+			long long target = (long long)selection + move;
+			target = std::max(0LL, std::min(target, (long long)(filter.size() - 1)));
+			if((move < -1) || (move > 1))
+				top = std::max(0LL, ((long long)top + (target - selection)));
+			selection = target;
+		}
+
+		//The selected item:
+		unsigned int id = filter.getId(selection);
 
 		//If the user has pressed Enter:
 		if(char(input) == '\n')
 		{
-			//Attempts to cast the current selection to a Directory*:
-			Directory* selected = dynamic_cast <Directory*>(items[selection + dir->getDotfiles()]);
-
-			//If the user has selected a directory:
-			if(selected != NULL)
+			//If the user has selected a directory, and is not already opening one:
+			if((items.isDirectory(id)) && (loading == NULL))
 			{
-				//Keep the old directory so we can delete it:
-				Directory* oldDir = dir;
-
-				//Makes a copy of the directory we want to move to:
+				//Goes straight back to the directory if it is kept, and has not
+				//changed, otherwise reads it in the background, and moves to it
+				//once its first run has been read:
 				try
 				{
-					dir = new Directory(selected);
-					dir->read();
+					Directory* next = new Directory(dir->getItemPath(id).c_str());
+					if(next->getName() == "../")
+						next->cleanPath();
 
-					delete oldDir;
-					selection = 0;
-
-					clear();
+					unsigned int selected = 0, shownTop = 0;
+					Directory* kept = cache.take(next, selected, shownTop);
+					if(kept != NULL)
+					{
+						delete next;
+						moveTo(kept);
+
+						//Selects the same item, with the same rows on screen, and
+						//checks the sizes of its subdirectories again, which the
+						//size cache answers without walking them if they are the
+						//same, and watches them once they are in:
+						unsigned int found = filter.indexOf(selected);
+						if(found < filter.size())
+							selection = found;
+						top = shownTop;
+						refreshSizes(dir, sizer);
+					}
+					else
+					{
+						prefetcher.cancel();
+						startLoading(next);
+					}
 				}
-				//If an error occurs, inform the user with a message box:
+				//If it cannot even be found, inform the user with a message box:
 				catch(int e)
 				{
-					std::string error = "Cannot open '" + dir->getPath() + "' ";
-					switch(errno)
+					std::string error = "Cannot open '" + dir->getItemPath(id) + "' ";
+					switch(e)
 					{
 						case EACCES:  error += "Permission denied."; break;
 						case ENOENT:  error += "No such directory."; break;
@@ -302,133 +797,347 @@ int main(int argc, char* argv[])
 				}
 			}
 		}
-		//Otherwise, if the user has pressed 'd' for delete:
-		else if((char(input) == 'd') || (char(input) == 'D'))
+		//Otherwise, if the user has pressed 'd' for delete. Nothing is deleted,
+		//pasted or renamed in a directory still being read, as the items it
+		//changes could be in a run still to come:
+		else if(((char(input) == 'd') || (char(input) == 'D')) && (dir != loading))
 		{
-			DiskItem* selected = items[selection + dir->getDotfiles()];
-			//Attempt to delete the selected item:
-			if(selected->deletef())
+			Batch* deleting = takeBatch(dir, id);
+			if(deleting != NULL)
 			{
-				delete selected;
-				dir->getFiles().erase(dir->getFiles().begin() + (selection + dir->getDotfiles()));
-
-				//If we deleted the last item, then 'selection + dir->getDotfiles()' will
-				//go out of bounds on the 'item' array, so decrement selection:
-				if((selection + dir->getDotfiles()) == dir->getFiles().size())
-					selection--;
+				//Deletes the marked items, or the selected one, in the background,
+				//counting what it removes, then takes them out of the listing, unless
+				//the watcher already has, or another directory is open:
+				std::string path = dir->getPath();
+				std::vector <std::string> names = getNames(deleting);
+				jobs.start(("Deleting " + describeBatch(deleting)),
+					[deleting](Progress& progress)
+					{
+						return (deleting->deletef(&progress) ? 0 : errno);
+					},
+					[&, deleting, path, names](int error)
+					{
+						//If an error occurs, inform the user with a message box, unless
+						//they cancelled it, in which case the watcher picks up what
+						//has been deleted:
+						if((error != 0) && (error != ECANCELED))
+							messageBox("Could not delete '" + deleting->getItemPath(deleting->size() - 1) + "'");
+						delete deleting;
+						if(error != 0)
+							return;
+
+						Listing& listing = dir->getListing();
+						for(unsigned int i = 0; (dir->getPath() == path) && (i < names.size()); i++)
+						{
+							unsigned int index = listing.find(names[i]);
+							if(index < listing.size())
+							{
+								unsigned int deleted = listing.getId(index);
+								sizer.forget(deleted);
+								watcher.forget(deleted);
+								listing.remove(index);
+							}
+						}
+					}, true);
 			}
-			//If an error occurs, inform the user with a message box:
-			else
+		}
+		//Otherwise, if the user has pressed 'c' for copy, or 'x' for cut:
+		else if((char(input) == 'C') || (char(input) == 'c') || (char(input) == 'X') || (char(input) == 'x'))
+		{
+			Batch* taken = takeBatch(dir, id);
+			if(taken != NULL)
 			{
-				std::string error = "Could not delete '" + selected->getPath() + "'";
-				messageBox(error);
+				//Replaces what was in the clipboard:
+				forgetClipboard(clipboard, sizer);
+				delete clipboard;
+				clipboard = taken;
+
+				if((char(input) == 'X') || (char(input) == 'x'))
+					clipboard->cut();
+
+				//Directories may still need sizing:
+				requestClipboard(clipboard, sizer);
 			}
 		}
-		//Otherwise, if the user has pressed 'c' for copy:
-		else if((char(input) == 'C') || (char(input) == 'c'))
+		//Otherwise, if the user has pressed 'p' for paste:
+		else if(((char(input) == 'P') || (char(input) == 'p')) && (dir != loading))
 		{
-			if(items[selection + dir->getDotfiles()]->getName() != "../")
+			if(clipboard != NULL)
 			{
-				//Checks if we are trying to copy a directory or a file:
-				clipboard = dynamic_cast <Directory*>(items[selection + dir->getDotfiles()]);
-
-				if(clipboard == NULL)
-				{
-					//We are copying a file:
-					clipboard = new File(dynamic_cast <File*>(items[selection + dir->getDotfiles()]));
-				}
-				else
-				{
-					//We are copying a directory:
-					clipboard = new Directory(dynamic_cast <Directory*>(items[selection + dir->getDotfiles()]));
-				}
+				//The clipboard is handed to the paste, which runs in the background,
+				//so nothing else can touch it until it has finished:
+				Batch* pasting = clipboard;
+				clipboard = NULL;
+				forgetClipboard(pasting, sizer);
+
+				std::string path = dir->getPath();
+				std::vector <std::string> names = getNames(pasting);
+				jobs.start(("Pasting " + describeBatch(pasting)),
+					[pasting, path](Progress& progress)
+					{
+						return (pasting->paste(path, &progress) ? 0 : errno);
+					},
+					[&, pasting, path, names](int error)
+					{
+						//If an error occurs, inform the user with a message box, unless they
+						//cancelled it, and put what is left back in the clipboard, unless
+						//something else is there:
+						if(error != 0)
+						{
+							if(error != ECANCELED)
+								messageBox("Could not paste " + describeBatch(pasting));
+							if((clipboard == NULL) && (pasting->size() > 0))
+							{
+								clipboard = pasting;
+								requestClipboard(clipboard, sizer);
+							}
+							else
+								delete pasting;
+							return;
+						}
+						delete pasting;
+
+						//If it works fine, add the new items to the directory's listing,
+						//unless they are already there, having been seen by the watcher,
+						//or another directory has been opened since:
+						Listing& listing = dir->getListing();
+						for(unsigned int i = 0; (dir->getPath() == path) && (i < names.size()); i++)
+						{
+							if(listing.find(names[i]) < listing.size())
+								continue;
+							try
+							{
+								unsigned int pasted = dir->insert(names[i].substr(0, (names[i].find('/'))));
+								if(listing.isDirectory(pasted))
+									sizer.request(pasted, dir->getItemPath(pasted));
+							}
+							catch(int e)
+							{
+							}
+						}
+					}, true);
 			}
 		}
-		//Otherwise, if the user has pressed 'x' for cut:
-		else if((char(input) == 'X') || (char(input) == 'x'))
+		//Otherwise, if the user presses 'm' or space, mark or unmark the selected
+		//item, and move on to the next:
+		else if((char(input) == 'M') || (char(input) == 'm') || (char(input) == ' '))
 		{
-			if(items[selection + dir->getDotfiles()]->getName() != "../")
+			if(! items.isParent(id))
+				items.setMarked(id, (! items.isMarked(id)));
+			if((selection + 1) < filter.size())
+				selection++;
+		}
+		//Otherwise, if the user presses '+' or '-', mark or unmark every item
+		//shown matching a pattern:
+		else if((char(input) == '+') || (char(input) == '-'))
+		{
+			std::string pattern = inputBox();
+			for(unsigned int i = 0; (pattern != "") && (i < filter.size()); i++)
 			{
-				//Checks if we are trying to cut a directory or a file:
-				clipboard = dynamic_cast <Directory*>(items[selection + dir->getDotfiles()]);
-
-				if(clipboard == NULL)
-				{
-					//We are cutting a file:
-					clipboard = new File(dynamic_cast <File*>(items[selection + dir->getDotfiles()]));
-				}
-				else
-				{
-					//We are cutting a directory:
-					clipboard = new Directory(dynamic_cast <Directory*>(items[selection + dir->getDotfiles()]));
-				}
-				clipboard->cut();
+				unsigned int item = filter.getId(i);
+				if((! items.isParent(item)) && (fnmatch(pattern.c_str(), items.getRawName(item), 0) == 0))
+					items.setMarked(item, (char(input) == '+'));
 			}
 		}
-		//Otherwise, if the user has pressed 'p' for paste:
-		else if((char(input) == 'P') || (char(input) == 'p'))
+		//Otherwise, if the user presses '*', mark every item shown not marked,
+		//and unmark every item which is:
+		else if(char(input) == '*')
 		{
-			if(clipboard != NULL)
+			for(unsigned int i = 0; i < filter.size(); i++)
 			{
-				//Attempt to paste the item in the clipboard:
-				if(! clipboard->paste(dir->getPath()))
-				{
-					//If an error occurs, inform the user with a message box:
-					std::string error = "Could not paste '" + clipboard->getName() + "'";
-					messageBox(error);
-				}
-				else
-				{
-					//If it works fine, add the new item to the directory's list of items:
-					DiskItem* item = clipboard;
-					dir->getFiles().push_back(item);
-					std::sort(dir->getFiles().begin(), dir->getFiles().end(), byName);
-
-					//Empty the clipboard:
-					clipboard = NULL;
-				}
+				unsigned int item = filter.getId(i);
+				if(! items.isParent(item))
+					items.setMarked(item, (! items.isMarked(item)));
 			}
 		}
+		//Otherwise, if the user presses 'n', switch between sorting numbers
+		//in names by their value and sorting them as text:
+		else if(((char(input) == 'N') || (char(input) == 'n')) && (dir != loading))
+		{
+			Listing::setNatural(! Listing::isNatural());
+			items.resort();
+
+			//Keeps the same item selected:
+			filter.update();
+			selection = filter.indexOf(id);
+		}
+		//Otherwise, if the user presses '/', start typing a filter, or change
+		//the one shown:
+		else if(char(input) == '/')
+			filtering = true;
+		//Otherwise, if the user presses an apostrophe, start typing the start
+		//of a name to jump to:
+		else if(char(input) == '\'')
+		{
+			jump = "";
+			jumping = true;
+		}
+		//Otherwise, if the user presses Escape, show every item again, keeping
+		//the same one selected:
+		else if((input == 27) && (filter.isActive()))
+		{
+			filter.clear();
+			selection = filter.indexOf(id);
+		}
+		//Otherwise, if the user presses 'w', show the jobs:
+		else if((char(input) == 'W') || (char(input) == 'w'))
+			jobsBox(jobs);
+		//Otherwise, if the user presses 's', show or hide the stats:
+		else if((char(input) == 'S') || (char(input) == 's'))
+			showStats = (! showStats);
 		//Otherwise, if the user presses 'r' for rename:
-		else if((char(input) == 'R') || (char(input) == 'r'))
+		else if(((char(input) == 'R') || (char(input) == 'r')) && (dir != loading))
 		{
 			//Get the new name, and attempt to rename the selected item:
 			std::string newName = inputBox();
-			if(newName != "")
+			DiskItem* selected = dir->getItem(items.indexOf(id));
+			if((newName != "") && (selected != NULL))
 			{
 				//Check if we are renaming a directory:
-				if(dynamic_cast <Directory*>(items[selection + dir->getDotfiles()]) != NULL)
+				if(items.isDirectory(id))
 					newName += '/';
 
-				if(! items[selection + dir->getDotfiles()]->rename(newName.c_str()))
+				if(! selected->rename(newName.c_str()))
 				{
 					//If an error occurs, inform the user with a message box:
-					std::string error = "Cannot rename '" + items[selection + dir->getDotfiles()]->getName() + "'";
+					std::string error = "Cannot rename '" + items.getName(id) + "'";
 					messageBox(error);
 				}
+				else
+				{
+					//Moves the item to its new place in the listing, keeping its size:
+					sizer.forget(id);
+					watcher.forget(id);
+					items.remove(items.indexOf(id));
+					try
+					{
+						unsigned int renamed = dir->insert(newName.substr(0, (newName.find('/'))));
+						if(selected->isSized())
+							items.setSize(renamed, selected->getSize());
+						else
+							sizer.request(renamed, dir->getItemPath(renamed));
+					}
+					catch(int e)
+					{
+					}
+				}
 			}
+			delete selected;
 		}
 	}
 
+	//Stops reading the directory being opened, which is still in use until
+	//its job has been collected:
+	if(loading != NULL)
+		jobs.cancel(loadingJob);
+	while(loading != NULL)
+	{
+		struct pollfd event = { notifier.getFd(), POLLIN, 0 };
+		struct timespec tick = { 0, 100000000 };
+		if(! jobs.collect())
+			ppoll(&event, 1, ((event.fd < 0) ? &tick : NULL), &waiting);
+		notifier.clear();
+	}
+
 	//Delete the directory object:
 	delete dir;
 
-	//Close ncurses:
+	//Close ncurses, and the trace:
 	endwin();
+	Stats::finish();
 	return 0;
 }
 
-//Prints the given DiskItem's metadata to the fileinfo window:
-void printMetaData(DiskItem* item)
+//Prints the name of the item with the given id, and its size on the right, to
+//the given row of the fileview window, highlighting the row if it is selected.
+//The name is printed straight from the listing, cut short if it does not fit:
+void printItem(unsigned int y, Listing& items, unsigned int id, bool selected)
+{
+	unsigned int width = fileview.width - 2;
+
+	//Clears whatever was on the row before:
+	mvwhline(fileview.window, y, 1, ' ', width);
+
+	//Print the name:
+	const char* name = items.getRawName(id);
+	unsigned int length = strlen(name);
+	mvwaddnstr(fileview.window, y, 1, name, width);
+	if(items.isDirectory(id))
+	{
+		length++;
+		if(length <= width)
+			waddch(fileview.window, '/');
+	}
+
+	//Print the size, if it fits after the name:
+	if(! items.isParent(id))
+	{
+		std::string size = items.getFormattedSize(id);
+		if((length + size.length() + 3) < fileview.width)
+			mvwprintw(fileview.window, y, ((fileview.width - 1) - size.length()), "%s", size.c_str());
+	}
+
+	//Move to the beginning of the line, and highlight the line up to but excluding the window border,
+	//with marked items in bold yellow:
+	if(selected)
+		mvwchgat(fileview.window, y, 1, width, (items.isMarked(id) ? A_BOLD : A_NORMAL), 1, NULL);
+	else if(items.isMarked(id))
+		mvwchgat(fileview.window, y, 1, width, A_BOLD, 3, NULL);
+}
+
+//Prints as many of the rows shown as fit in the fileview window, starting
+//from the given row, and notes which are still being sized:
+void printItems(Listing& items, Filter& filter, unsigned int top, unsigned int selection, std::vector <unsigned int>& visible)
+{
+	unsigned int rows = (fileview.height > 2) ? (fileview.height - 2) : 0;
+
+	for(unsigned int i = top; (i < (top + rows)) && (i < filter.size()); i++)
+	{
+		unsigned int id = filter.getId(i);
+		printItem(((i - top) + 1), items, id, (i == selection));
+		if(! items.isSized(id))
+			visible.push_back(id);
+	}
+}
+
+//Up and down move by a row, Page Up and Page Down by the rows on screen,
+//and Control with U and D by half of them. Home and End go to either end,
+//as far as the selection can be moved:
+int getMove(int input, unsigned int rows)
+{
+	int page = std::max(rows, 1u);
+	int half = std::max((rows / 2), 1u);
+
+	if((input == KEY_UP) || (char(input) == 'k') || (char(input) == 'K'))
+		return -1;
+	if((input == KEY_DOWN) || (char(input) == 'j') || (char(input) == 'J'))
+		return 1;
+	if((input == KEY_PPAGE) || (input == 2))
+		return -page;
+	if((input == KEY_NPAGE) || (input == 6))
+		return page;
+	if(input == 21)
+		return -half;
+	if(input == 4)
+		return half;
+	if((input == KEY_HOME) || (char(input) == 'g'))
+		return INT_MIN;
+	if((input == KEY_END) || (char(input) == 'G'))
+		return INT_MAX;
+	return 0;
+}
+
+//Prints the metadata of the item with the given id to the fileinfo window:
+void printMetaData(Listing& items, unsigned int id)
 {
 	//Gets the size of window, so we know how much we can print:
 	unsigned int h = fileinfo.height - 2;
 	
 	//Print the name:
-	if(h > 0) mvwprintw(fileinfo.window, 1, 1, "%s", item->getName().c_str());
+	if(h > 0) mvwprintw(fileinfo.window, 1, 1, "%s", items.getName(id).c_str());
 
 	//Print if it is a file or directory:
-	if(item->getName()[item->getName().size() - 1] == '/')
+	if(items.isDirectory(id))
 	{
 		if(h > 1)
 			mvwprintw(fileinfo.window, 2, 1, "%s", "Directory");
@@ -440,12 +1149,12 @@ void printMetaData(DiskItem* item)
 	}
 
 	//Print the filesize:
-	if((h > 2) && (item->getName() != "../"))
-		mvwprintw(fileinfo.window, 3, 1, "%s", item->getFormattedSize().c_str());
+	if((h > 2) && (! items.isParent(id)))
+		mvwprintw(fileinfo.window, 3, 1, "%s", items.getFormattedSize(id).c_str());
 }
 
 //Prints the given DiskItem's metadata to the extrainfo window:
-void printClipboard(DiskItem* clipboard)
+void printClipboard(Batch* clipboard)
 {
 	//Check the clipboard isn't empty:
 	if(clipboard != NULL)
@@ -456,11 +1165,17 @@ void printClipboard(DiskItem* clipboard)
 		//Print the title:
 		if(h > 0) mvwprintw(extrainfo.window, 1, 1, "%s", "CLIPBOARD:");
 
-		//Print the name:
-		if(h > 1) mvwprintw(extrainfo.window, 2, 1, "%s", clipboard->getName().c_str());
+		//Print the name, or how many items there are:
+		if(h > 1) mvwprintw(extrainfo.window, 2, 1, "%s", ((clipboard->size() == 1) ? clipboard->getName(0) :
+			(std::to_string(clipboard->size()) + " items")).c_str());
 
 		//Print if it is a file or directory:
-		if(clipboard->getName()[clipboard->getName().size() - 1] == '/')
+		if(clipboard->size() > 1)
+		{
+			if(h > 2)
+				mvwprintw(extrainfo.window, 3, 1, "%s", "Items");
+		}
+		else if(clipboard->isDirectory(0))
 		{
 			if(h > 2)
 				mvwprintw(extrainfo.window, 3, 1, "%s", "Directory");
@@ -472,18 +1187,91 @@ void printClipboard(DiskItem* clipboard)
 		}
 
 		//Print the filesize:
-		if((h > 3) && (clipboard->getName() != "../"))
+		if(h > 3)
 			mvwprintw(extrainfo.window, 4, 1, "%s", clipboard->getFormattedSize().c_str());
 	}
 }
 
-//Updates the window size:
-void updateWindows()
+//Prints what each job is doing in the extrainfo window, below the clipboard:
+void printJobs(Batch* clipboard, const std::vector <Jobs::Status>& running)
 {
-	//Clears the windows:
-	wclear(fileview.window);
-	wclear(fileinfo.window);
-	wclear(extrainfo.window);
+	//The rows left under the clipboard:
+	unsigned int y = (clipboard != NULL) ? 5 : 1;
+	if((running.size() == 0) || ((y + 1) >= (extrainfo.height - 1)))
+		return;
+
+	//Print the title:
+	mvwprintw(extrainfo.window, y, 1, "%s", "WORKING:");
+
+	//Print as many of the jobs as fit, each after how far it has got, which
+	//would be cut off at the end of a long description:
+	for(unsigned int i = 0; (i < running.size()) && ((y + 1 + i) < (extrainfo.height - 1)); i++)
+	{
+		std::string line = formatProgress(running[i]);
+		line += (line.empty() ? "" : " ") + running[i].name;
+		mvwaddnstr(extrainfo.window, (y + 1 + i), 1, line.c_str(), (extrainfo.width - 2));
+	}
+}
+
+//Prints the stats in the extrainfo window, with the rates worked out over
+//the last second or so:
+void printStats()
+{
+	//The counters when the rates were last worked out, and the rates:
+	static int64_t sampled = 0;
+	static uint64_t last[Stats::COUNTERS] = { 0 };
+	static uint64_t rates[Stats::COUNTERS] = { 0 };
+
+	int64_t now = Stats::now();
+	if((now - sampled) >= 1000000000LL)
+	{
+		for(unsigned int i = 0; i < Stats::COUNTERS; i++)
+		{
+			uint64_t count = Stats::get((Stats::Counter)i);
+			rates[i] = (sampled == 0) ? 0 : (((count - last[i]) * 1000000000ULL) / (now - sampled));
+			last[i] = count;
+		}
+		sampled = now;
+	}
+
+	char frame[32];
+	snprintf(frame, sizeof(frame), "%.2fms", (Stats::getLast(Stats::FRAME) / 1e6));
+
+	std::string lines[] =
+	{
+		"STATS:",
+		"Frame: " + std::string(frame),
+		"Scanned: " + formatCount(rates[Stats::SCANNED]) + "/s",
+		"Syscalls: " + formatCount(rates[Stats::SYSCALLS]) + "/s",
+		"Copied: " + formatSize(rates[Stats::COPIED]) + "/s"
+	};
+	for(unsigned int i = 0; (i < 5) && ((i + 1) < (extrainfo.height - 1)); i++)
+		mvwaddnstr(extrainfo.window, (i + 1), 1, lines[i].c_str(), (extrainfo.width - 2));
+}
+
+//Returns the count with a 'k' or 'M' if it is big:
+std::string formatCount(unsigned long long count)
+{
+	char text[32];
+	if(count >= 10000000)
+		snprintf(text, sizeof(text), "%lluM", (count / 1000000));
+	else if(count >= 10000)
+		snprintf(text, sizeof(text), "%lluk", (count / 1000));
+	else
+		snprintf(text, sizeof(text), "%llu", count);
+	return text;
+}
+
+//Creates the windows to fit the screen, deleting the old ones:
+void createWindows()
+{
+	//Deletes the windows made for the old size:
+	if(fileview.window != NULL)
+	{
+		delwin(fileview.window);
+		delwin(fileinfo.window);
+		delwin(extrainfo.window);
+	}
 
 	//Gets the screen size:
 	getmaxyx(stdscr, screenY, screenX);
@@ -508,10 +1296,32 @@ void updateWindows()
 	fileinfo.window = newwin(fileinfo.height, fileinfo.width, fileinfo.y, fileinfo.x);
 	extrainfo.window = newwin(extrainfo.height, extrainfo.width, extrainfo.y, extrainfo.x);
 
-	//Creates a border around each of the windows:
+	//Clears anything left over from the old size:
+	clear();
+}
+
+//Clears the fileview window and draws its border, the path and the help:
+void drawFrame(const std::string& directory)
+{
+	//Clears the window and draws the border around it:
+	werase(fileview.window);
 	wborder(fileview.window, '|', '|', '-', '-', '+', '+', '+', '+');
-	wborder(fileinfo.window, '|', '|', '-', '-', '+', '+', '+', '+');
-	wborder(extrainfo.window, '|', '|', '-', '-', '+', '+', '+', '+');
+
+	//If necessary, resizes the directory path:
+	std::string path = "";
+	if(directory.length() >= screenX)
+		path = fitToSize(directory, (screenX - 2));
+	else
+		path = directory;
+
+	//The X position needed to print the path in the centre, over
+	//whatever path was there before:
+	int pos = ((screenX - path.length()) / 2);
+	move(0, 0);
+	clrtoeol();
+	mvprintw(0, pos, "%s", path.c_str());
+
+	drawHelp();
 }
 
 //Draws the help text:
@@ -526,6 +1336,33 @@ void drawHelp()
 	attroff(COLOR_PAIR(1));
 }
 
+//Draws the query, then how it matches and how many items it matches on
+//the right, in the help text's colours:
+void drawFilter(Filter& filter, bool typing)
+{
+	std::string status = std::string("[") + Filter::getName(filter.getMode()) + "] ";
+	if(filter.hasFailed())
+		status += "no matches ";
+	else if(filter.isActive())
+		status += std::to_string(filter.size()) + " shown ";
+
+	attron(COLOR_PAIR(1));
+	mvhline((screenY - 1), 0, ' ', screenX);
+	mvprintw((screenY - 1), 0, " /%s%s", filter.getQuery().c_str(), (typing ? "_" : ""));
+	if((filter.getQuery().size() + status.size() + 4) < screenX)
+		mvprintw((screenY - 1), (screenX - status.size()), "%s", status.c_str());
+	attroff(COLOR_PAIR(1));
+}
+
+//Draws the prefix with a cursor after it, in the help text's colours:
+void drawJump(const std::string& prefix)
+{
+	attron(COLOR_PAIR(1));
+	mvhline((screenY - 1), 0, ' ', screenX);
+	mvprintw((screenY - 1), 0, " '%s_", prefix.c_str());
+	attroff(COLOR_PAIR(1));
+}
+
 //Creates a message box with the given message and keeps it on screen:
 void messageBox(std::string message)
 {
@@ -564,15 +1401,161 @@ void messageBox(std::string message)
 	wrefresh(messagebox.window);
 
 	//Continuously get input, until the user presses the 'Enter' key:
+	timeout(-1);
 	int input = 0;
 	while(char(input) != '\n')
 		input = getch();	
 
-	//Clear the window:
-	wclear(messagebox.window);
+	//Delete the window, and clear what it covered:
+	delwin(messagebox.window);
 	clear();
 }
 
+//Shows the jobs in a box over the other windows, drawing it again every
+//quarter of a second so their progress is seen, until it is closed:
+void jobsBox(Jobs& jobs)
+{
+	//Initialise the two colour pairs:
+	init_pair(4, COLOR_WHITE, COLOUR);
+	init_pair(5, COLOR_WHITE, COLOR_RED);
+
+	//Make the box as big as the screen, less a margin:
+	messagebox.width = (screenX > 8) ? (screenX - 4) : screenX;
+	messagebox.height = (screenY > 8) ? (screenY - 4) : screenY;
+	messagebox.x = (screenX - messagebox.width) / 2;
+	messagebox.y = (screenY - messagebox.height) / 2;
+	messagebox.window = newwin(messagebox.height, messagebox.width, messagebox.y, messagebox.x);
+	wbkgd(messagebox.window, COLOR_PAIR(4));
+
+	//The selected job, kept by its id as jobs come and go:
+	unsigned int selected = 0;
+	bool chosen = false;
+
+	timeout(250);
+	int input = 0;
+	while((char(input) != 'q') && (char(input) != 'Q') && (char(input) != 'w') && (char(input) != 'W') &&
+		(char(input) != '\n'))
+	{
+		std::vector <Jobs::Status> running = jobs.getRunning();
+		std::vector <Jobs::Status> history = jobs.getHistory();
+
+		//Finds where the selected job is, or selects the first:
+		unsigned int index = 0;
+		while((index < running.size()) && (chosen) && (running[index].id != selected))
+			index++;
+		if(index == running.size())
+			index = 0;
+
+		//Moves the selection, and pauses or cancels the selected job:
+		if(running.size() > 0)
+		{
+			if(((input == KEY_UP) || (char(input) == 'k') || (char(input) == 'K')) && (index > 0))
+				index--;
+			if(((input == KEY_DOWN) || (char(input) == 'j') || (char(input) == 'J')) && ((index + 1) < running.size()))
+				index++;
+			if((char(input) == 'c') || (char(input) == 'C'))
+				jobs.cancel(running[index].id);
+			if((char(input) == 'p') || (char(input) == 'P'))
+				jobs.pause(running[index].id);
+
+			selected = running[index].id;
+			chosen = true;
+		}
+
+		werase(messagebox.window);
+		wborder(messagebox.window, '|', '|', '-', '-', '+', '+', '+', '+');
+		unsigned int width = messagebox.width - 2;
+		unsigned int rows = messagebox.height - 3;
+
+		//Print each job, how far it has got and how fast, and how long it has
+		//left, with its description last so it is what gets cut off:
+		unsigned int y = 1;
+		mvwaddnstr(messagebox.window, y++, 1, "RUNNING:", width);
+		for(unsigned int i = 0; (i < running.size()) && (y < rows); i++, y++)
+		{
+			const Jobs::Status& job = running[i];
+			std::string done = (job.totalBytes > 0) ? (formatSize(job.bytes) + " of " + formatSize(job.totalBytes)) :
+				(std::to_string(job.items) + " items");
+			std::string rate = (job.byteRate > 0) ? (formatSize(job.byteRate) + "/s") :
+				((job.itemRate > 0) ? (std::to_string((unsigned long long)job.itemRate) + "/s") : "");
+			std::string left = (job.remaining >= 0) ? formatTime(job.remaining) : "";
+
+			char line[512];
+			snprintf(line, sizeof(line), "%-7s %-20s %-10s %-8s %s", formatProgress(job).c_str(), done.c_str(),
+				rate.c_str(), left.c_str(), job.name.c_str());
+			mvwaddnstr(messagebox.window, y, 1, line, width);
+			if(i == index)
+				mvwchgat(messagebox.window, y, 1, width, A_NORMAL, 5, NULL);
+		}
+
+		//Print the jobs which have finished, and why any failed:
+		if((history.size() > 0) && ((y + 1) < rows))
+		{
+			y++;
+			mvwaddnstr(messagebox.window, y++, 1, "FINISHED:", width);
+			for(unsigned int i = 0; (i < history.size()) && (y < rows); i++, y++)
+			{
+				const Jobs::Status& job = history[i];
+				std::string state = "Done";
+				if(job.state == Jobs::CANCELLED)
+					state = "Cancelled";
+				else if(job.state == Jobs::FAILED)
+					state = std::string("Failed: ") + ((job.error > 0) ? strerror(job.error) : "Unknown error");
+
+				std::string rate = (job.byteRate > 0) ? (formatSize(job.byteRate) + "/s") : "";
+				std::string line = job.name + " - " + state;
+				if((job.state == Jobs::DONE) && (! rate.empty()))
+					line += " (" + rate + ")";
+				mvwaddnstr(messagebox.window, y, 1, line.c_str(), width);
+			}
+		}
+
+		//Print the keys:
+		wattron(messagebox.window, COLOR_PAIR(5));
+		mvwaddnstr(messagebox.window, (messagebox.height - 2), 1, "C: Cancel P: Pause/Resume W: Close", width);
+		wattroff(messagebox.window, COLOR_PAIR(5));
+		wrefresh(messagebox.window);
+
+		input = getch();
+	}
+
+	//Delete the window, and clear what it covered:
+	delwin(messagebox.window);
+	clear();
+}
+
+//A job's progress is a percentage if its total is known, otherwise the
+//number of items it has done:
+std::string formatProgress(const Jobs::Status& job)
+{
+	if(job.state == Jobs::PAUSED)
+		return "Paused";
+	if(job.state == Jobs::QUEUED)
+		return "Queued";
+	if(job.totalBytes > 0)
+	{
+		unsigned long long done = (job.bytes < job.totalBytes) ? job.bytes : job.totalBytes;
+		return std::to_string((done * 100) / job.totalBytes) + "%";
+	}
+	if(job.totalItems > 0)
+		return std::to_string(job.items) + "/" + std::to_string(job.totalItems);
+	if(job.items > 0)
+		return std::to_string(job.items);
+	return "";
+}
+
+std::string formatTime(long long seconds)
+{
+	char text[32];
+	if(seconds >= 3600)
+		snprintf(text, sizeof(text), "%lldh%02lldm", (seconds / 3600), ((seconds / 60) % 60));
+	else if(seconds >= 60)
+		snprintf(text, sizeof(text), "%lldm%02llds", (seconds / 60), (seconds % 60));
+	else
+		snprintf(text, sizeof(text), "%llds", seconds);
+	return text;
+}
+
 //Creates an input box that allows the user to enter a string and returns it:
 std::string inputBox()
 {
@@ -603,6 +1586,9 @@ std::string inputBox()
 	int input = 0, selection = 0;
 	std::string inputStr = "";
 
+	//Waits for each key:
+	timeout(-1);
+
 	//The loop is indefinite, and ends when the user
 	//presses '<OK>' or '<CANCEL>':
 	while(1)
@@ -669,13 +1655,15 @@ std::string inputBox()
 				//contents of the text box:
 				case 1: wclear(inputbox.window);
 						wrefresh(inputbox.window);
-						if(inputStr.size() == 0) return NULL; else return inputStr; 
+						delwin(inputbox.window);
+						return inputStr;
 						break;
 
 				//The user has clicked '<CANCEL>', return
 				//nothing:
 				case 2: wclear(inputbox.window);
 						wrefresh(inputbox.window);
+						delwin(inputbox.window);
 						return "";
 						break;
 			}
@@ -701,37 +1689,129 @@ std::string inputBox()
 	}
 }
 
-//Takes a directory path and returns it shrunk to the given size or smaller:
-std::string fitToSize(std::string path, unsigned int size)
+bool isValidInput(char c)
 {
-	//The position in the string, starts at 1 to skip the first '/':
-	int pos = 1;
-	while(path.length() > size)
+	if((isalnum(c)) || (c == '.') || (c == '-') || (c == '_') || (c == '*') || (c == '?') || (c == '[') || (c == ']'))
+		return true;
+
+	return false;
+}
+
+//Queues the sizes of the directory's subdirectories to be calculated, from
+//the id given on, as the items merged in a run are given the ids after:
+void requestSizes(Directory* dir, Sizer& sizer, unsigned int first)
+{
+	Listing& items = dir->getListing();
+	for(unsigned int id = first; id < items.getIds(); id++)
+	{
+		if((! items.isSized(id)) && (! items.isParent(id)))
+			sizer.request(id, dir->getItemPath(id));
+	}
+}
+
+//Goes through the listing in order, as items may have been removed from it:
+void refreshSizes(Directory* dir, Sizer& sizer)
+{
+	Listing& items = dir->getListing();
+	for(unsigned int i = 0; i < items.size(); i++)
+	{
+		unsigned int id = items.getId(i);
+		if((items.isDirectory(id)) && (! items.isParent(id)))
+			sizer.request(id, dir->getItemPath(id));
+	}
+}
+
+//Gives an item in the listing the size calculated for it. A change is only
+//applied to a size already known, otherwise the full size is on its way.
+//An item which could not be sized says so instead, and is not watched:
+bool applySize(Listing& items, const Sizer::Result& result)
+{
+	if(result.error != 0)
+	{
+		items.setUnreadable(result.id);
+		return false;
+	}
+
+	if(result.relative)
+	{
+		if(items.isSized(result.id))
+			items.setSize(result.id, (items.getSize(result.id) + result.delta));
+		return false;
+	}
+
+	items.setSize(result.id, result.size);
+	return true;
+}
+
+//Takes the marked items, in the order they are shown:
+Batch* takeBatch(Directory* dir, unsigned int id)
+{
+	Listing& items = dir->getListing();
+	Batch* batch = NULL;
+	try
 	{
-		//Gets the directory name between the '/':
-		int newPos = path.find('/', pos);
-		std::string dir = path.substr(pos, (newPos - pos));
+		batch = new Batch(dir->getPath());
+	}
+	catch(int e)
+	{
+		return NULL;
+	}
 
-		//The characters removed, minus 1 for the '/':
-		int removed = dir.length() - 2;
+	for(unsigned int i = items.getDotfiles(); (items.getMarked() > 0) && (i < items.size()); i++)
+	{
+		unsigned int item = items.getId(i);
+		if(! items.isMarked(item))
+			continue;
 
-		//Replace the directory name with the first letter:
-		dir = dir[0];
+		if(items.isSized(item))
+			batch->add(items.getRawName(item), items.isDirectory(item), items.getSize(item));
+		else
+			batch->add(items.getRawName(item), items.isDirectory(item));
+		items.setMarked(item, false);
+	}
 
-		//Grabs the bit of the path before and after the edit to build the string:
-		std::string front = path.substr(0, pos);
-		std::string back = path.substr(newPos, (path.size() - newPos));
-		path = (front + dir + back);
+	if((batch->size() == 0) && (! items.isParent(id)))
+	{
+		if(items.isSized(id))
+			batch->add(items.getRawName(id), items.isDirectory(id), items.getSize(id));
+		else
+			batch->add(items.getRawName(id), items.isDirectory(id));
+	}
 
-		pos = newPos - removed;
+	if(batch->size() == 0)
+	{
+		delete batch;
+		return NULL;
 	}
-	return path;
+	return batch;
 }
 
-bool isValidInput(char c)
+std::vector <std::string> getNames(Batch* batch)
 {
-	if((isalnum(c)) || (c == '.') || (c == '-') || (c == '_'))
-		return true;
+	std::vector <std::string> names;
+	for(unsigned int i = 0; i < batch->size(); i++)
+		names.push_back(batch->getName(i));
+	return names;
+}
 
-	return false;
+std::string describeBatch(Batch* batch)
+{
+	if(batch->size() == 1)
+		return "'" + batch->getName(0) + "'";
+	return std::to_string(batch->size()) + " items";
+}
+
+//Each item is sized under its own id, counting down from the first:
+void requestClipboard(Batch* clipboard, Sizer& sizer)
+{
+	for(unsigned int i = 0; (clipboard != NULL) && (i < clipboard->size()) && (i < CLIPBOARD_ITEMS); i++)
+		if(! clipboard->isSized(i))
+			sizer.request((CLIPBOARD - i), clipboard->getItemPath(i));
+}
+
+void forgetClipboard(Batch* clipboard, Sizer& sizer)
+{
+	for(unsigned int i = 0; (clipboard != NULL) && (i < clipboard->size()) && (i < CLIPBOARD_ITEMS); i++)
+		if(! clipboard->isSized(i))
+			sizer.forget(CLIPBOARD - i);
 }
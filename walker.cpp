@@ -0,0 +1,484 @@
+// --- walker.cpp
+#include "walker.h"
+#include "dirReader.h"
+#include "stats.h"
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+//The state shared by every node in a single walk:
+struct Walk
+{
+	WalkVisitor* visitor;
+	const std::atomic <bool>* cancelled;
+
+	//False if items only need to be stat'ed when their type is unknown:
+	bool attributes;
+
+	//True if directories are kept open until they are finished:
+	bool parents;
+
+	//Set when the root node finishes:
+	std::mutex lock;
+	std::condition_variable finished;
+	bool done;
+	unsigned long long size;
+
+	//The error reading the root directory, if there was one:
+	int error;
+};
+
+//The most finished nodes each thread keeps to reuse:
+static const unsigned int POOL_SIZE = 4096;
+
+//The nodes a thread has finished with, kept so a walk does not have to
+//allocate a node, and a path, for every directory. Each node keeps the
+//room its path had, so a path of the same depth can be built in it:
+struct NodePool
+{
+	std::vector <WalkNode*> nodes;
+
+	~NodePool()
+	{
+		for(unsigned int i = 0; i < nodes.size(); i++)
+			delete nodes[i];
+	}
+};
+static thread_local NodePool pool;
+
+//Gets a node, reusing one the thread has finished with if it can:
+static WalkNode* newNode()
+{
+	if(pool.nodes.empty())
+		return new WalkNode;
+
+	WalkNode* node = pool.nodes.back();
+	pool.nodes.pop_back();
+	return node;
+}
+
+//Finishes with a node, keeping it to reuse if there is room:
+static void freeNode(WalkNode* node)
+{
+	if(pool.nodes.size() < POOL_SIZE)
+		pool.nodes.push_back(node);
+	else
+		delete node;
+}
+
+//Returns true if the walk has been cancelled:
+static bool isCancelled(Walk* walk)
+{
+	return ((walk->cancelled != NULL) && (*walk->cancelled));
+}
+
+Walker::Walker(unsigned int threads)
+{
+	_queued = 0;
+	_sleeping = 0;
+	_next = 0;
+	_stopping = false;
+
+	//Always have at least one worker:
+	if(threads == 0)
+		threads = 1;
+
+	//Each directory being walked is held open until its subdirectories
+	//have been opened, so allow as many open files as the system will:
+	struct rlimit limit;
+	if((getrlimit(RLIMIT_NOFILE, &limit) == 0) && (limit.rlim_cur < limit.rlim_max))
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	for(unsigned int i = 0; i < threads; i++)
+	{
+		_queues.push_back(new Queue);
+		_buffers.push_back(new char[DirReader::BUFFER_SIZE]);
+	}
+	for(unsigned int i = 0; i < threads; i++)
+		_workers.push_back(std::thread(&Walker::work, this, i));
+}
+
+Walker::~Walker()
+{
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_stopping = true;
+	}
+	_wake.notify_all();
+
+	for(unsigned int i = 0; i < _workers.size(); i++)
+		_workers[i].join();
+
+	for(unsigned int i = 0; i < _queues.size(); i++)
+	{
+		delete _queues[i];
+		delete[] _buffers[i];
+	}
+}
+
+//The number of threads in each pool of workers, 0 for one each processor:
+static std::atomic <unsigned int> threads(0);
+
+//Returns the walker shared by the whole program:
+Walker& Walker::shared()
+{
+	static Walker walker(getThreads());
+	return walker;
+}
+
+void Walker::setThreads(unsigned int number)
+{
+	threads = number;
+}
+
+unsigned int Walker::getThreads()
+{
+	if(threads > 0)
+		return threads;
+	return std::thread::hardware_concurrency();
+}
+
+unsigned long long Walker::walk(const std::string& path, WalkVisitor* visitor, const std::atomic <bool>* cancelled)
+{
+	//Reads the root's attributes, following it if it is a link
+	//so it behaves the same as opening a Directory:
+	struct stat attr;
+	if(stat(path.c_str(), &attr) != 0)
+		throw errno;
+
+	//There is nothing to walk if it is not a directory:
+	if(S_ISDIR(attr.st_mode) == 0)
+		return attr.st_size;
+
+	return start(-1, path, attr, visitor, cancelled);
+}
+
+unsigned long long Walker::walk(int fd, const std::string& path, WalkVisitor* visitor, const std::atomic <bool>* cancelled)
+{
+	struct stat attr;
+	if(fstat(fd, &attr) != 0)
+	{
+		int error = errno;
+		close(fd);
+		throw error;
+	}
+
+	return start(fd, path, attr, visitor, cancelled);
+}
+
+//Sets up the walk and its root, then reads the root on this thread:
+unsigned long long Walker::start(int fd, const std::string& path, const struct stat& attr, WalkVisitor* visitor,
+	const std::atomic <bool>* cancelled)
+{
+	Walk walk;
+	walk.visitor = visitor;
+	walk.cancelled = cancelled;
+	walk.attributes = ((visitor == NULL) || (visitor->needsAttributes()));
+	walk.parents = ((visitor != NULL) && (visitor->needsParents()));
+	walk.done = false;
+	walk.size = 0;
+	walk.error = 0;
+
+	WalkNode* root = newNode();
+	root->parent = NULL;
+	root->path = path;
+	if(root->path[root->path.size() - 1] != '/')
+		root->path += '/';
+	root->name = 0;
+	root->fd = fd;
+	root->unopened = 1;
+	root->attr = attr;
+	root->size = attr.st_size;
+	root->pending = 1;
+	root->walk = &walk;
+	root->data = NULL;
+
+	//Reads the root here, so a directory with no subdirectories is
+	//walked without waking a worker. Any subdirectories are spread
+	//across the workers' queues, then it waits for them to finish:
+	process(-1, root);
+	{
+		std::unique_lock <std::mutex> guard(walk.lock);
+		while(! walk.done)
+			walk.finished.wait(guard);
+	}
+
+	if(isCancelled(&walk))
+	{
+		errno = ECANCELED;
+		throw errno;
+	}
+	if(walk.error != 0)
+	{
+		errno = walk.error;
+		throw errno;
+	}
+
+	return walk.size;
+}
+
+void Walker::work(unsigned int id)
+{
+	WalkNode* node = take(id);
+	while(node != NULL)
+	{
+		process(id, node);
+		node = take(id);
+	}
+}
+
+//Queues a node on the given worker's queue:
+void Walker::push(unsigned int id, WalkNode* node)
+{
+	{
+		std::lock_guard <std::mutex> guard(_queues[id]->lock);
+		_queues[id]->nodes.push_back(node);
+	}
+	_queued++;
+
+	//Only wakes a worker if one is asleep, which saves a system call
+	//for every directory while they are all busy. Taking the lock means
+	//a worker that has just seen nothing queued is already waiting:
+	if(_sleeping > 0)
+	{
+		std::lock_guard <std::mutex> guard(_lock);
+		_wake.notify_one();
+	}
+}
+
+//Gets the next node for the given worker:
+WalkNode* Walker::take(unsigned int id)
+{
+	while(true)
+	{
+		//Takes the newest node from its own queue, so each worker
+		//goes deep into its part of the tree:
+		{
+			Queue* queue = _queues[id];
+			std::lock_guard <std::mutex> guard(queue->lock);
+			if(! queue->nodes.empty())
+			{
+				WalkNode* node = queue->nodes.back();
+				queue->nodes.pop_back();
+				_queued--;
+				return node;
+			}
+		}
+
+		//Otherwise steals the oldest node from another worker, which
+		//is the one nearest the root, so likely the most work:
+		for(unsigned int i = 1; i < _queues.size(); i++)
+		{
+			Queue* queue = _queues[(id + i) % _queues.size()];
+			std::lock_guard <std::mutex> guard(queue->lock);
+			if(! queue->nodes.empty())
+			{
+				WalkNode* node = queue->nodes.front();
+				queue->nodes.pop_front();
+				_queued--;
+				return node;
+			}
+		}
+
+		//Otherwise sleeps until something is queued:
+		std::unique_lock <std::mutex> guard(_lock);
+		_sleeping++;
+		while((! _stopping) && (_queued == 0))
+			_wake.wait(guard);
+		_sleeping--;
+
+		if(_stopping)
+			return NULL;
+	}
+}
+
+//Reads the directory a node refers to, queuing its subdirectories:
+void Walker::process(int id, WalkNode* node)
+{
+	Walk* walk = node->walk;
+	WalkNode* parent = node->parent;
+
+	if(! isCancelled(walk))
+	{
+		if(walk->visitor != NULL)
+			walk->visitor->entered(node);
+
+		//Opens the directory relative to its parent, so the kernel does
+		//not have to look up the whole path again. Links are not
+		//followed, so a link to a parent directory cannot make the walk
+		//loop. The root may have been opened already:
+		if(parent == NULL)
+		{
+			if(node->fd < 0)
+			{
+				Stats::count(Stats::SYSCALLS);
+				node->fd = open(node->path.c_str(), (O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+			}
+		}
+		else
+		{
+			Stats::count(Stats::SYSCALLS);
+			node->fd = openat(parent->fd, (node->path.c_str() + node->name), (O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+		}
+
+		//Only the root failing to open stops the walk, anything
+		//below it that cannot be read is skipped:
+		if((node->fd < 0) && (parent == NULL))
+			walk->error = errno;
+		else if((node->fd < 0) && (walk->visitor != NULL))
+			walk->visitor->failed(node, errno);
+
+		//If the parent only knew the type, the attributes come from the open directory:
+		if((node->fd >= 0) && (! walk->attributes) && (parent != NULL))
+			if(fstat(node->fd, &node->attr) == 0)
+				node->size = node->attr.st_size;
+	}
+
+	//The parent no longer needs to be open for this directory:
+	if(parent != NULL)
+		opened(parent);
+
+	if(node->fd >= 0)
+	{
+		//The sizes of the files, and the items stat'ed, are added up
+		//here, so the shared totals are only updated once:
+		unsigned long long size = 0;
+		unsigned int stats = 0;
+
+		//A thread that is not a worker reads into a buffer of its own:
+		static thread_local std::vector <char> buffer;
+		char* read = NULL;
+		if(id >= 0)
+			read = _buffers[id];
+		else
+		{
+			buffer.resize(DirReader::BUFFER_SIZE);
+			read = &buffer[0];
+		}
+
+		DirReader reader(node->fd, read, DirReader::BUFFER_SIZE);
+		const char* name = NULL;
+		unsigned char type = DT_UNKNOWN;
+		try
+		{
+			while((! isCancelled(walk)) && (reader.next(name, type)))
+			{
+				//Only stats the item if its attributes are needed, or if the
+				//directory could not say whether it is a directory:
+				struct stat attr;
+				if((walk->attributes) || (type == DT_UNKNOWN))
+				{
+					stats++;
+					if(fstatat(node->fd, name, &attr, AT_SYMLINK_NOFOLLOW) != 0)
+						continue;
+				}
+				else
+				{
+					memset(&attr, 0, sizeof(attr));
+					attr.st_mode = DTTOIF(type);
+				}
+
+				if(S_ISDIR(attr.st_mode) != 0)
+				{
+					//Only directories get a node, and so a path:
+					WalkNode* child = newNode();
+					child->parent = node;
+					child->path = node->path;
+					child->name = child->path.size();
+					child->path += name;
+					child->path += '/';
+					child->fd = -1;
+					child->unopened = 1;
+					child->attr = attr;
+					child->size = attr.st_size;
+					child->pending = 1;
+					child->walk = walk;
+					child->data = NULL;
+
+					node->pending++;
+					node->unopened++;
+					if(id >= 0)
+						push(id, child);
+					else
+						push((_next++ % _queues.size()), child);
+				}
+				else
+				{
+					size += attr.st_size;
+					if(walk->visitor != NULL)
+						walk->visitor->file(node, name, attr);
+				}
+			}
+		}
+		catch(int e)
+		{
+			//A directory which cannot be read to the end fails the same
+			//way as one which cannot be opened:
+			if(parent == NULL)
+				walk->error = e;
+			else if(walk->visitor != NULL)
+				walk->visitor->failed(node, e);
+		}
+
+		node->size += size;
+		Stats::count(Stats::SYSCALLS, stats);
+	}
+
+	//The node has been read, so its directory can be closed once its
+	//subdirectories are open, and it is finished once they are:
+	opened(node);
+	release(node);
+}
+
+//Marks one of the node's subdirectories as opened:
+void Walker::opened(WalkNode* node)
+{
+	if((--node->unopened == 0) && (node->fd >= 0) && (! node->walk->parents))
+	{
+		close(node->fd);
+		node->fd = -1;
+	}
+}
+
+//Marks one of the node's pending tasks as done:
+void Walker::release(WalkNode* node)
+{
+	while((node != NULL) && (--node->pending == 0))
+	{
+		Walk* walk = node->walk;
+		WalkNode* parent = node->parent;
+
+		if((walk->visitor != NULL) && (! isCancelled(walk)))
+			walk->visitor->finished(node);
+
+		//A directory kept open for its children is closed once they are done:
+		if(node->fd >= 0)
+		{
+			close(node->fd);
+			node->fd = -1;
+		}
+
+		//Adds the finished directory's total to its parent's:
+		if(parent != NULL)
+			parent->size += node->size;
+		//Otherwise the root is finished, so the walk is done. Nothing
+		//may touch the walk after this, as the caller owns it:
+		else
+		{
+			std::lock_guard <std::mutex> guard(walk->lock);
+			walk->size = node->size;
+			walk->done = true;
+			walk->finished.notify_all();
+		}
+
+		freeNode(node);
+		node = parent;
+	}
+}
@@ -0,0 +1,179 @@
+// ---
+// walker.h
+//
+// Contains the class definition for the
+// walker, which walks directory trees on
+// a pool of threads. Each thread keeps its
+// own queue of directories still to be
+// read, and steals from the others when
+// it runs out, so a single deep or wide
+// tree is spread across every thread.
+// ---
+
+#ifndef WALKER_H
+#define WALKER_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+struct Walk;
+
+//A directory found during a walk. Only directories get a node,
+//everything else is handled as it is read:
+struct WalkNode
+{
+	//The directory containing this one, NULL for the root:
+	WalkNode* parent;
+
+	//The full path, ending in a '/', and where the directory's
+	//own name starts in it:
+	std::string path;
+	unsigned int name;
+
+	//The open directory, which stays open until every subdirectory
+	//has been opened relative to it, or if the visitor needs it to,
+	//until the node is finished:
+	int fd;
+	std::atomic <unsigned int> unopened;
+
+	//The directory's own attributes:
+	struct stat attr;
+
+	//The total size of the directory and everything below it,
+	//complete once the node is passed to 'finished()':
+	std::atomic <unsigned long long> size;
+
+	//The number of things left to do before the node is finished,
+	//one for reading the directory plus one per unfinished child:
+	std::atomic <unsigned int> pending;
+
+	//The walk the node belongs to:
+	Walk* walk;
+
+	//Left for the visitor to use, NULL until it is set:
+	void* data;
+};
+
+//Used by anything that needs to do more than add up sizes. The
+//functions are called from the walker's threads, many at once:
+class WalkVisitor
+{
+	public:
+		//Virtual destructor:
+		virtual ~WalkVisitor() { }
+
+		//Returns false if the walk only needs to know which items
+		//are directories, in which case items are only stat'ed if the
+		//directory does not say what type they are, and the attributes
+		//passed to 'file()' only have the type set:
+		virtual bool needsAttributes() { return true; }
+
+		//Returns true if each directory has to stay open until it is
+		//finished, so 'finished()' can still use its parent's:
+		virtual bool needsParents() { return false; }
+
+		//Called before the directory is read:
+		virtual void entered(WalkNode*) { }
+
+		//Called for each item in the directory that is
+		//not itself a directory:
+		virtual void file(WalkNode*, const char*, const struct stat&) { }
+
+		//Called once the directory and everything below
+		//it has been walked:
+		virtual void finished(WalkNode*) { }
+
+		//Called with errno when a directory below the root cannot
+		//be opened, before it is skipped:
+		virtual void failed(WalkNode*, int) { }
+};
+
+class Walker
+{
+	private:
+		//A worker's queue of directories still to be read:
+		struct Queue
+		{
+			std::mutex lock;
+			std::deque <WalkNode*> nodes;
+		};
+
+		//The worker threads, their queues, and the buffers
+		//they read directories into:
+		std::vector <std::thread> _workers;
+		std::vector <Queue*> _queues;
+		std::vector <char*> _buffers;
+
+		//The number of nodes queued across every worker:
+		std::atomic <unsigned int> _queued;
+
+		//The number of workers asleep waiting for nodes:
+		std::atomic <unsigned int> _sleeping;
+
+		//The queue the next walk is started on:
+		std::atomic <unsigned int> _next;
+
+		//Used to put idle workers to sleep:
+		std::mutex _lock;
+		std::condition_variable _wake;
+		bool _stopping;
+
+		//The main loop for each of the worker threads:
+		void work(unsigned int);
+
+		//Queues a node on the given worker's queue:
+		void push(unsigned int, WalkNode*);
+
+		//Gets the next node for the given worker, stealing one
+		//if it has none, returns NULL when stopping:
+		WalkNode* take(unsigned int);
+
+		//Reads the directory a node refers to, on the given worker,
+		//or -1 if it is the thread which started the walk:
+		void process(int, WalkNode*);
+
+		//Marks one of the node's subdirectories as opened, closing
+		//the node's directory once they all have been:
+		void opened(WalkNode*);
+
+		//Marks one of the node's pending tasks as done,
+		//finishing it and its parents as they complete:
+		void release(WalkNode*);
+
+		//Walks the directory with the attributes given, open as the fd
+		//given, or -1 to open it from its path:
+		unsigned long long start(int, const std::string&, const struct stat&, WalkVisitor*, const std::atomic <bool>*);
+
+	public:
+		//Default constructor, takes the number of worker threads:
+		Walker(unsigned int);
+
+		//Destructor, stops and joins the workers:
+		~Walker();
+
+		//Walks the tree at the given path, returning its total size.
+		//Subdirectories that cannot be read are skipped, if the path
+		//itself cannot be read, or the flag passed becomes true, the
+		//walk stops and throws errno:
+		unsigned long long walk(const std::string&, WalkVisitor*, const std::atomic <bool>*);
+
+		//Walks the tree in the directory open as the fd given, the same
+		//way, with the path given. The walker takes over the fd:
+		unsigned long long walk(int, const std::string&, WalkVisitor*, const std::atomic <bool>*);
+
+		//Returns the walker shared by the whole program:
+		static Walker& shared();
+
+		//Sets the number of threads each pool of workers has, which
+		//is one for each processor unless set, only before the shared
+		//walker is first used:
+		static void setThreads(unsigned int);
+		static unsigned int getThreads();
+};
+
+#endif
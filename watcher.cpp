@@ -0,0 +1,242 @@
+// --- watcher.cpp
+#include "watcher.h"
+#include "sizeCache.h"
+#include <cerrno>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//The most directories watched at once, so a huge tree does
+//not use up the user's inotify watches:
+static const unsigned int MAX_WATCHES = 8192;
+
+//The events that can change a listing or a size:
+static const uint32_t MASK = (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW);
+
+Watcher::Watcher()
+{
+	//If inotify is not available, nothing is watched and
+	//the listing just does not update itself:
+	_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+Watcher::~Watcher()
+{
+	if(_fd >= 0)
+		close(_fd);
+}
+
+//Returns the inotify file descriptor:
+int Watcher::getFd()
+{
+	return _fd;
+}
+
+//Adds a watch on the given directory:
+bool Watcher::add(const std::string& path, unsigned int id, const std::string& root)
+{
+	if((_fd < 0) || (_watches.size() >= MAX_WATCHES))
+		return false;
+
+	int wd = inotify_add_watch(_fd, path.c_str(), MASK);
+	if(wd < 0)
+		return false;
+
+	Watch watch;
+	watch.path = path;
+	watch.id = id;
+	watch.root = root;
+	_watches[wd] = watch;
+
+	return true;
+}
+
+//Removes every watch, and watches the passed directory:
+void Watcher::watch(Directory* dir)
+{
+	for(std::map <int, Watch>::iterator i = _watches.begin(); i != _watches.end(); i++)
+		inotify_rm_watch(_fd, i->first);
+	_watches.clear();
+
+	add(dir->getPath(), Sizer::NONE, dir->getPath());
+}
+
+//Watches the recorded subdirectories of the passed item, so a change
+//anywhere below it can be added to its size:
+void Watcher::watchSubtree(unsigned int id, const std::string& path)
+{
+	if(_fd < 0)
+		return;
+
+	if(! add(path, id, path))
+		return;
+
+	std::vector <std::string> paths;
+	SizeCache::shared().subdirectories(path, paths, (MAX_WATCHES - _watches.size()));
+	for(unsigned int i = 0; i < paths.size(); i++)
+		if(! add(paths[i], id, path))
+			break;
+}
+
+//Removes the watches for the passed id:
+void Watcher::forget(unsigned int id)
+{
+	for(std::map <int, Watch>::iterator i = _watches.begin(); i != _watches.end();)
+	{
+		if(i->second.id == id)
+		{
+			inotify_rm_watch(_fd, i->first);
+			_watches.erase(i++);
+		}
+		else
+			i++;
+	}
+}
+
+//Handles any waiting events:
+bool Watcher::update(Directory* dir, Sizer& sizer)
+{
+	if(_fd < 0)
+		return false;
+
+	//The items in the current directory which changed, and the
+	//directories further down which changed:
+	std::set <std::string> names;
+	std::set <int> subdirs;
+	bool current = false;
+	bool overflow = false;
+
+	//Reads every waiting event, so a burst of changes to the same
+	//item is only handled once:
+	char buffer[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length = read(_fd, buffer, sizeof(buffer));
+	while(length > 0)
+	{
+		for(char* p = buffer; p < (buffer + length); p += (sizeof(struct inotify_event) + ((struct inotify_event*)p)->len))
+		{
+			struct inotify_event* event = (struct inotify_event*)p;
+
+			if(event->mask & IN_Q_OVERFLOW)
+			{
+				overflow = true;
+				continue;
+			}
+
+			std::map <int, Watch>::iterator watch = _watches.find(event->wd);
+			if(watch == _watches.end())
+				continue;
+
+			//The directory has gone, so has its watch:
+			if(event->mask & IN_IGNORED)
+			{
+				_watches.erase(watch);
+				continue;
+			}
+
+			if(watch->second.id == Sizer::NONE)
+			{
+				current = true;
+				if(event->len > 0)
+					names.insert(event->name);
+			}
+			else
+			{
+				subdirs.insert(event->wd);
+
+				//Watches new directories so their changes are seen too:
+				if((event->mask & (IN_CREATE | IN_MOVED_TO)) && (event->mask & IN_ISDIR))
+					add((watch->second.path + event->name + '/'), watch->second.id, watch->second.root);
+			}
+		}
+		length = read(_fd, buffer, sizeof(buffer));
+	}
+
+	//If events were lost, the whole listing has to be checked:
+	if(overflow)
+		resync(dir, sizer);
+	else
+		for(std::set <std::string>::iterator i = names.begin(); i != names.end(); i++)
+			changed(dir, sizer, *i);
+
+	//Updates the cached sizes of the changed directories, adding the
+	//change to the size of the item they are in:
+	for(std::set <int>::iterator i = subdirs.begin(); i != subdirs.end(); i++)
+	{
+		std::map <int, Watch>::iterator watch = _watches.find(*i);
+		if(watch != _watches.end())
+			sizer.refresh(watch->second.id, watch->second.root, watch->second.path);
+	}
+	if(current || overflow)
+		sizer.refresh(Sizer::NONE, "", dir->getPath());
+
+	return ((overflow) || (! names.empty()));
+}
+
+//Updates the listing after the named item in it changed:
+void Watcher::changed(Directory* dir, Sizer& sizer, const std::string& name)
+{
+	Listing& listing = dir->getListing();
+	unsigned int index = listing.find(name);
+
+	std::string path = dir->getPath() + name;
+	struct stat attr;
+	bool exists = (stat(path.c_str(), &attr) == 0);
+
+	if(index < listing.size())
+	{
+		unsigned int id = listing.getId(index);
+		bool isDir = listing.isDirectory(id);
+
+		//A file that is still a file just needs its new size:
+		if((exists) && (! isDir) && (S_ISDIR(attr.st_mode) == 0))
+		{
+			listing.setSize(id, attr.st_size);
+			return;
+		}
+		//A directory that is still a directory is updated by its own watches:
+		if((exists) && (isDir) && (S_ISDIR(attr.st_mode) != 0))
+			return;
+
+		//Otherwise it has gone, or been replaced by something else:
+		listing.remove(index);
+		sizer.forget(id);
+		forget(id);
+	}
+
+	if(! exists)
+		return;
+
+	//Adds the new item, sizing it if it is a directory:
+	unsigned int id = listing.insert(name.c_str(), attr);
+	if(S_ISDIR(attr.st_mode) != 0)
+		sizer.request(id, dir->getItemPath(id));
+}
+
+//Brings the listing back in line with the directory:
+void Watcher::resync(Directory* dir, Sizer& sizer)
+{
+	std::set <std::string> names;
+
+	//Everything in the listing:
+	Listing& listing = dir->getListing();
+	for(unsigned int i = 0; i < listing.size(); i++)
+		if(! listing.isParent(listing.getId(i)))
+			names.insert(listing.getRawName(listing.getId(i)));
+
+	//And everything in the directory:
+	DIR* d = opendir(dir->getPath().c_str());
+	if(d != NULL)
+	{
+		for(dirent* entry = readdir(d); entry != NULL; entry = readdir(d))
+		{
+			std::string name = entry->d_name;
+			if((name != ".") && (name != ".."))
+				names.insert(name);
+		}
+		closedir(d);
+	}
+
+	for(std::set <std::string>::iterator i = names.begin(); i != names.end(); i++)
+		changed(dir, sizer, *i);
+}
@@ -0,0 +1,76 @@
+// ---
+// watcher.h
+//
+// Contains the class definition for the
+// watcher, which uses inotify to keep the
+// listing of the current directory, and
+// the sizes of its subdirectories, up to
+// date with changes made outside of the
+// program, by patching them in place.
+// ---
+
+#ifndef WATCHER_H
+#define WATCHER_H
+#include "directory.h"
+#include "sizer.h"
+#include <map>
+#include <set>
+#include <string>
+
+class Watcher
+{
+	private:
+		//A watched directory, and the id and path of the item in the
+		//listing whose size includes it. The id is Sizer::NONE for
+		//the current directory:
+		struct Watch
+		{
+			std::string path;
+			unsigned int id;
+			std::string root;
+		};
+
+		//The inotify instance, -1 if it could not be created:
+		int _fd;
+
+		//The watched directories, by watch descriptor:
+		std::map <int, Watch> _watches;
+
+		//Adds a watch on the given directory, returns false if
+		//there are too many watches:
+		bool add(const std::string&, unsigned int, const std::string&);
+
+		//Brings the listing back in line with the directory after
+		//events have been lost:
+		void resync(Directory*, Sizer&);
+
+		//Updates the listing after the named item in it changed:
+		void changed(Directory*, Sizer&, const std::string&);
+
+	public:
+		//Default constructor:
+		Watcher();
+
+		//Destructor:
+		~Watcher();
+
+		//Removes every watch, and watches the passed directory:
+		void watch(Directory*);
+
+		//Watches the recorded subdirectories of the item with the
+		//passed id and path:
+		void watchSubtree(unsigned int, const std::string&);
+
+		//Removes the watches for the passed id, must be called
+		//before the item is removed from the listing:
+		void forget(unsigned int);
+
+		//Handles any waiting events, updating the passed directory
+		//and queuing size changes, returns true if anything changed:
+		bool update(Directory*, Sizer&);
+
+		//Returns the inotify file descriptor, or -1 if there is none:
+		int getFd();
+};
+
+#endif